@@ -23,6 +23,7 @@
 */
 
 #include <cmath>
+#include <cstring>
 
 #include <algorithm>
 #include <memory>
@@ -30,126 +31,880 @@
 
 #include "CAS.h"
 
-#ifdef CAS_X86
-template<typename pixel_t> extern void filter_sse2(const VSFrameRef * src, VSFrameRef * dst, const CASData * const VS_RESTRICT data, const VSAPI * vsapi) noexcept;
-template<typename pixel_t> extern void filter_avx2(const VSFrameRef * src, VSFrameRef * dst, const CASData * const VS_RESTRICT data, const VSAPI * vsapi) noexcept;
-template<typename pixel_t> extern void filter_avx512(const VSFrameRef * src, VSFrameRef * dst, const CASData * const VS_RESTRICT data, const VSAPI * vsapi) noexcept;
-#endif
-
 template<typename pixel_t>
-static void filter_c(const VSFrameRef * src, VSFrameRef * dst, const CASData * const VS_RESTRICT data, const VSAPI * vsapi) noexcept {
-    using var_t = std::conditional_t<std::is_integral_v<pixel_t>, int, float>;
+static void filterRegion(const VSFrameRef * src, VSFrameRef * dst, const int * roi, const CASData * const VS_RESTRICT data, const VSAPI * vsapi) noexcept {
+    for (int plane = 0; plane < data->vi->format->numPlanes; plane++) {
+        if (data->process[plane]) {
+            const int ssw = plane ? data->vi->format->subSamplingW : 0;
+            const int ssh = plane ? data->vi->format->subSamplingH : 0;
+            const int planeWidth = vsapi->getFrameWidth(src, plane);
+            const int planeHeight = vsapi->getFrameHeight(src, plane);
+            const int left = roi[0] >> ssw;
+            const int top = roi[1] >> ssh;
+            const int width = planeWidth - left - (roi[2] >> ssw);
+            const int height = planeHeight - top - (roi[3] >> ssh);
+            const int stride = vsapi->getStride(src, plane) / sizeof(pixel_t);
+            const pixel_t * srcp = reinterpret_cast<const pixel_t *>(vsapi->getReadPtr(src, plane));
+            pixel_t * dstp = reinterpret_cast<pixel_t *>(vsapi->getWritePtr(dst, plane));
 
-    const var_t limit = std::any_cast<var_t>(data->limit);
+            // Everything outside the region is copied.
+            vs_bitblt(dstp, stride * sizeof(pixel_t), srcp, stride * sizeof(pixel_t), planeWidth * sizeof(pixel_t), top);
+            vs_bitblt(dstp + (top + height) * stride, stride * sizeof(pixel_t), srcp + (top + height) * stride, stride * sizeof(pixel_t), planeWidth * sizeof(pixel_t),
+                      planeHeight - top - height);
 
-    auto filtering = [&](const var_t a, const var_t b, const var_t c, const var_t d, const var_t e, const var_t f, const var_t g, const var_t h, const var_t i,
-                         const float chromaOffset) noexcept {
-        // Soft min and max.
-        //  a b c             b
-        //  d e f * 0.5  +  d e f * 0.5
-        //  g h i             h
-        // These are 2.0x bigger (factored out the extra multiply).
-        var_t mn = std::min({ d, e, f, b, h });
-        const var_t mn2 = std::min({ mn, a, c, g, i });
-        mn += mn2;
+            srcp += top * stride;
+            dstp += top * stride;
 
-        var_t mx = std::max({ d, e, f, b, h });
-        const var_t mx2 = std::max({ mx, a, c, g, i });
-        mx += mx2;
+            // The kernels store whole aligned vectors, so unless the region starts on a vector boundary each row is sharpened into a scratch row first.
+            const bool aligned = !(left * sizeof(pixel_t) % 64);
+            CASScratch buffer{ aligned ? 0 : (((width + 63) & ~63) + 64) * sizeof(pixel_t) };
 
-        if constexpr (std::is_floating_point_v<pixel_t>) {
-            mn += chromaOffset;
-            mx += chromaOffset;
-        }
+            for (int y = 0; y < height; y++) {
+                const pixel_t * above = srcp + (y == 0 ? stride : -stride);
+                const pixel_t * below = srcp + (y == height - 1 ? -stride : stride);
 
-        // Smooth minimum distance to signal limit divided by smooth max.
-        float amp = std::clamp(std::min(mn, limit - mx) / static_cast<float>(mx), 0.0f, 1.0f);
+                if (aligned) {
+                    data->filterRow(above + left, srcp + left, below + left, dstp + left, width, plane, data);
+                } else {
+                    data->filterRow(above + left, srcp + left, below + left, buffer.get<pixel_t>(), width, plane, data);
+                    std::copy_n(buffer.get<pixel_t>(), width, dstp + left);
+                }
 
-        // Shaping amount of sharpening.
-        amp = std::sqrt(amp);
+                std::copy_n(srcp, left, dstp);
+                std::copy(srcp + left + width, srcp + planeWidth, dstp + left + width);
 
-        // Filter shape.
-        //  0 w 0
-        //  w 1 w
-        //  0 w 0
-        const float weight = amp * data->sharpness;
-        return ((b + d + f + h) * weight + e) / (1.0f + 4.0f * weight);
-    };
+                srcp += stride;
+                dstp += stride;
+            }
+        }
+    }
+}
+
+template<typename pixel_t>
+static float filterBlocks(const VSFrameRef * src, VSFrameRef * dst, const VSFrameRef * previousSrc, const VSFrameRef * previousDst, const bool * reused,
+                          const CASData * const VS_RESTRICT data, const VSAPI * vsapi) noexcept {
+    // A block whose source samples, including a one sample halo, are identical to those of the previous frame has identical output,
+    // so it is copied from the previous output. Changed blocks are sharpened in runs by the row kernel.
+    constexpr int blockSize = 64;
+    int blocks = 0, hits = 0;
 
     for (int plane = 0; plane < data->vi->format->numPlanes; plane++) {
         if (data->process[plane]) {
             const int width = vsapi->getFrameWidth(src, plane);
             const int height = vsapi->getFrameHeight(src, plane);
+            const int columns = (width + blockSize - 1) / blockSize;
+
+            // Planes identical to the previous source already share the previous output plane.
+            if (reused[plane]) {
+                hits += columns * ((height + blockSize - 1) / blockSize);
+                blocks += columns * ((height + blockSize - 1) / blockSize);
+                continue;
+            }
+
             const int stride = vsapi->getStride(src, plane) / sizeof(pixel_t);
+            const int previousStride = vsapi->getStride(previousSrc, plane) / sizeof(pixel_t);
             const pixel_t * srcp = reinterpret_cast<const pixel_t *>(vsapi->getReadPtr(src, plane));
-            pixel_t * VS_RESTRICT dstp = reinterpret_cast<pixel_t *>(vsapi->getWritePtr(dst, plane));
+            const pixel_t * previousSrcp = reinterpret_cast<const pixel_t *>(vsapi->getReadPtr(previousSrc, plane));
+            const pixel_t * previousDstp = reinterpret_cast<const pixel_t *>(vsapi->getReadPtr(previousDst, plane));
+            pixel_t * dstp = reinterpret_cast<pixel_t *>(vsapi->getWritePtr(dst, plane));
 
-            const float chromaOffset = plane ? 1.0f : 0.0f;
+            std::vector<bool> unchanged(columns);
 
-            for (int y = 0; y < height; y++) {
-                const pixel_t * above = srcp + (y == 0 ? stride : -stride);
-                const pixel_t * below = srcp + (y == height - 1 ? -stride : stride);
+            // Runs start up to 16 samples early so that the kernels see the same vector layout as a whole row, and are sharpened into a scratch row.
+            CASScratch buffer{ (((width + 63) & ~63) + 64) * sizeof(pixel_t) };
+
+            for (int top = 0; top < height; top += blockSize) {
+                const int bottom = std::min(top + blockSize, height);
 
-                {
-                    const float result = filtering(above[1], above[0], above[1],
-                                                   srcp[1], srcp[0], srcp[1],
-                                                   below[1], below[0], below[1],
-                                                   chromaOffset);
+                for (int column = 0; column < columns; column++) {
+                    const int left = std::max(column * blockSize - 1, 0);
+                    const int right = std::min((column + 1) * blockSize + 1, width);
+                    bool equal = true;
+                    for (int y = std::max(top - 1, 0); y < std::min(bottom + 1, height) && equal; y++)
+                        equal = !std::memcmp(srcp + y * stride + left, previousSrcp + y * previousStride + left, (right - left) * sizeof(pixel_t));
 
-                    if constexpr (std::is_integral_v<pixel_t>)
-                        dstp[0] = std::clamp(static_cast<int>(result + 0.5f), 0, data->peak);
-                    else
-                        dstp[0] = result;
+                    unchanged[column] = equal;
+                    hits += equal;
+                    blocks++;
                 }
 
-                for (int x = 1; x < width - 1; x++) {
-                    const float result = filtering(above[x - 1], above[x], above[x + 1],
-                                                   srcp[x - 1], srcp[x], srcp[x + 1],
-                                                   below[x - 1], below[x], below[x + 1],
-                                                   chromaOffset);
+                for (int y = top; y < bottom; y++) {
+                    const pixel_t * row = srcp + y * stride;
+                    const pixel_t * above = row + (y == 0 ? stride : -stride);
+                    const pixel_t * below = row + (y == height - 1 ? -stride : stride);
+
+                    for (int column = 0; column < columns;) {
+                        const int first = column;
+                        const bool hit = unchanged[column];
+                        while (column < columns && unchanged[column] == hit)
+                            column++;
 
-                    if constexpr (std::is_integral_v<pixel_t>)
-                        dstp[x] = std::clamp(static_cast<int>(result + 0.5f), 0, data->peak);
-                    else
-                        dstp[x] = result;
+                        const int left = first * blockSize;
+                        const int right = std::min(column * blockSize, width);
+
+                        if (hit) {
+                            std::copy(previousDstp + y * previousStride + left, previousDstp + y * previousStride + right, dstp + y * stride + left);
+                        } else {
+                            const int start = std::max(left - 16, 0);
+                            const int end = std::min(right + 1, width);
+
+                            // A run starting at the left edge is sharpened in place; anything it writes past its end is overwritten by the next run.
+                            if (start == 0) {
+                                data->filterRow(above, row, below, dstp + y * stride, end, plane, data);
+                            } else {
+                                data->filterRow(above + start, row + start, below + start, buffer.get<pixel_t>(), end - start, plane, data);
+                                std::copy(buffer.get<pixel_t>() + left - start, buffer.get<pixel_t>() + right - start, dstp + y * stride + left);
+                            }
+                        }
+                    }
                 }
+            }
+        }
+    }
+
+    return blocks ? static_cast<float>(hits) / blocks : 0.0f;
+}
+
+template<typename pixel_t>
+static void findBorders(const VSFrameRef * src, int * roi, const CASData * const VS_RESTRICT data, const VSAPI * vsapi) noexcept {
+    // Borders are runs of rows and columns on the first plane whose samples all stay within a small tolerance of the corner sample.
+    const int width = vsapi->getFrameWidth(src, 0);
+    const int height = vsapi->getFrameHeight(src, 0);
+    const int stride = vsapi->getStride(src, 0) / sizeof(pixel_t);
+    const pixel_t * srcp = reinterpret_cast<const pixel_t *>(vsapi->getReadPtr(src, 0));
+
+    using var_t = std::conditional_t<std::is_integral_v<pixel_t>, int, float>;
+
+    const var_t tolerance = std::is_integral_v<pixel_t> ? static_cast<var_t>(4 << (data->vi->format->bitsPerSample - 8)) : static_cast<var_t>(4.0f / 255.0f);
+
+    auto bounds = [&](const var_t color) noexcept {
+        if constexpr (std::is_integral_v<pixel_t>)
+            return std::make_pair(static_cast<pixel_t>(std::max(color - tolerance, 0)), static_cast<pixel_t>(std::min(color + tolerance, data->peak)));
+        else
+            return std::make_pair(color - tolerance, color + tolerance);
+    };
+
+    auto run = [&](const pixel_t * p, const int n, const int step, const var_t color) noexcept {
+        const auto [low, high] = bounds(color);
+        int i = 0;
+        while (i < n && p[i * step] >= low && p[i * step] <= high)
+            i++;
+        return i;
+    };
+
+    auto constant = [&](const pixel_t * p, const var_t color) noexcept {
+        // Checked in blocks without an early exit inside a block so that the comparison vectorizes.
+        const auto [low, high] = bounds(color);
+        for (int x = 0; x < width; x += 256) {
+            const int n = std::min(256, width - x);
+            bool outside = false;
+            for (int i = 0; i < n; i++)
+                outside |= (p[x + i] < low) | (p[x + i] > high);
+            if (outside)
+                return false;
+        }
+        return true;
+    };
+
+    const var_t topLeft = srcp[0];
+    const var_t bottomRight = srcp[(height - 1) * stride + width - 1];
+
+    int top = 0, bottom = 0, left = width, right = width;
+
+    while (top < height && constant(srcp + top * stride, topLeft))
+        top++;
+
+    while (bottom < height - top && constant(srcp + (height - 1 - bottom) * stride, bottomRight))
+        bottom++;
+
+    for (int y = top; y < height - bottom && left > 0; y++)
+        left = run(srcp + y * stride, left, 1, topLeft);
+
+    for (int y = top; y < height - bottom && right > 0; y++)
+        right = run(srcp + y * stride + width - 1, std::min(right, width - left), -1, bottomRight);
+
+    // Margins are rounded down to the subsampling, and dropped entirely when they would leave too little of any plane.
+    const int ssw = data->vi->format->subSamplingW;
+    const int ssh = data->vi->format->subSamplingH;
+    roi[0] = left & ~((1 << ssw) - 1);
+    roi[1] = top & ~((1 << ssh) - 1);
+    roi[2] = right & ~((1 << ssw) - 1);
+    roi[3] = bottom & ~((1 << ssh) - 1);
+
+    if ((width - roi[0] - roi[2]) >> ssw < 3)
+        roi[0] = roi[2] = 0;
 
-                {
-                    const float result = filtering(above[width - 2], above[width - 1], above[width - 2],
-                                                   srcp[width - 2], srcp[width - 1], srcp[width - 2],
-                                                   below[width - 2], below[width - 1], below[width - 2],
-                                                   chromaOffset);
+    if ((height - roi[1] - roi[3]) >> ssh < 3)
+        roi[1] = roi[3] = 0;
+}
+
+template<typename pixel_t>
+static void fillPadding(const VSFrameRef * src, VSFrameRef * dst, const CASData * const VS_RESTRICT data, const VSAPI * vsapi) noexcept {
+    for (int plane = 0; plane < data->vi->format->numPlanes; plane++) {
+        const int ssw = plane ? data->vi->format->subSamplingW : 0;
+        const int ssh = plane ? data->vi->format->subSamplingH : 0;
+        const int width = data->width[plane];
+        const int height = data->height[plane];
+        const int dstWidth = vsapi->getFrameWidth(dst, plane);
+        const int dstHeight = vsapi->getFrameHeight(dst, plane);
+        const int dstStride = vsapi->getStride(dst, plane) / sizeof(pixel_t);
+        pixel_t * dstp = reinterpret_cast<pixel_t *>(vsapi->getWritePtr(dst, plane));
+        const pixel_t value = static_cast<pixel_t>(data->padValue[plane]);
+
+        // Planes that are not sharpened still only have the cropped region copied.
+        if (!data->process[plane]) {
+            const int srcStride = vsapi->getStride(src, plane) / sizeof(pixel_t);
+            const pixel_t * srcp = reinterpret_cast<const pixel_t *>(vsapi->getReadPtr(src, plane)) + (data->crop[1] >> ssh) * srcStride + (data->crop[0] >> ssw);
+            vs_bitblt(dstp, dstStride * sizeof(pixel_t), srcp, srcStride * sizeof(pixel_t), width * sizeof(pixel_t), height);
+        }
+
+        for (int y = 0; y < height; y++)
+            std::fill(dstp + y * dstStride + width, dstp + y * dstStride + dstWidth, data->padConstant ? value : dstp[y * dstStride + width - 1]);
+
+        for (int y = height; y < dstHeight; y++) {
+            if (data->padConstant)
+                std::fill_n(dstp + y * dstStride, dstWidth, value);
+            else
+                std::copy_n(dstp + (height - 1) * dstStride, dstWidth, dstp + y * dstStride);
+        }
+    }
+}
+
+template<typename pixel_t>
+static void ladder(const VSFrameRef * src, VSFrameRef ** dst, const CASLadderData * const VS_RESTRICT data, const VSAPI * vsapi) noexcept {
+    const int numOutputs = static_cast<int>(data->vi.size());
+
+    for (int plane = 0; plane < data->cas.vi->format->numPlanes; plane++) {
+        const int srcHeight = vsapi->getFrameHeight(src, plane);
+        const int srcStride = vsapi->getStride(src, plane) / sizeof(pixel_t);
+        const pixel_t * srcp = reinterpret_cast<const pixel_t *>(vsapi->getReadPtr(src, plane));
+
+        // Per output: a ring of horizontally resized rows covering the vertical taps, and a window of three resized rows awaiting sharpening.
+        // Rows of the window are padded so that the SIMD kernels may read past the right edge. All of them share one piece of scratch.
+        std::vector<float *> hbuffer(numOutputs), accumulator(numOutputs);
+        std::vector<pixel_t *> window(numOutputs);
+        std::vector<int> windowStride(numOutputs), next(numOutputs);
+
+        auto floatsSize = [&](const int k) noexcept {
+            return (static_cast<size_t>(vsapi->getFrameWidth(dst[k], plane)) * (data->rows[plane][k].size + 1) * sizeof(float) + 63) & ~static_cast<size_t>(63);
+        };
+
+        size_t size = 0;
+        for (int k = 0; k < numOutputs; k++) {
+            windowStride[k] = ((vsapi->getFrameWidth(dst[k], plane) + 63) & ~63) + 64;
+            size += floatsSize(k) + windowStride[k] * 3 * sizeof(pixel_t);
+        }
+
+        CASScratch scratch{ size };
+        uint8_t * scratchp = scratch.get<uint8_t>();
+        for (int k = 0; k < numOutputs; k++) {
+            hbuffer[k] = reinterpret_cast<float *>(scratchp);
+            accumulator[k] = hbuffer[k] + vsapi->getFrameWidth(dst[k], plane) * data->rows[plane][k].size;
+            window[k] = reinterpret_cast<pixel_t *>(scratchp + floatsSize(k));
+            scratchp += floatsSize(k) + windowStride[k] * 3 * sizeof(pixel_t);
+        }
+
+        auto emit = [&](const int k, const int y) noexcept {
+            const CASTaps & rows = data->rows[plane][k];
+            const int dstWidth = vsapi->getFrameWidth(dst[k], plane);
+            const int dstHeight = vsapi->getFrameHeight(dst[k], plane);
+            const int dstStride = vsapi->getStride(dst[k], plane) / sizeof(pixel_t);
+            pixel_t * dstp = reinterpret_cast<pixel_t *>(vsapi->getWritePtr(dst[k], plane));
+            auto row = [&](const int y) noexcept { return window[k] + windowStride[k] * (y % 3); };
+
+            // Vertical pass into the window, or straight into the frame when the plane is not sharpened.
+            float * VS_RESTRICT sum = accumulator[k];
+            const float * weight = rows.weight.data() + rows.size * y;
+            std::fill_n(sum, dstWidth, 0.0f);
+            for (int t = 0; t < rows.size; t++) {
+                const float * hp = hbuffer[k] + dstWidth * ((rows.first[y] + t) % rows.size);
+                for (int x = 0; x < dstWidth; x++)
+                    sum[x] += hp[x] * weight[t];
+            }
+
+            pixel_t * VS_RESTRICT target = data->cas.process[plane] ? row(y) : dstp + dstStride * y;
+            for (int x = 0; x < dstWidth; x++) {
+                if constexpr (std::is_integral_v<pixel_t>)
+                    target[x] = std::clamp(static_cast<int>(sum[x] + 0.5f), 0, data->cas.peak);
+                else
+                    target[x] = sum[x];
+            }
+
+            if (!data->cas.process[plane])
+                return;
 
-                    if constexpr (std::is_integral_v<pixel_t>)
-                        dstp[width - 1] = std::clamp(static_cast<int>(result + 0.5f), 0, data->peak);
-                    else
-                        dstp[width - 1] = result;
+            if (y >= 1)
+                data->cas.filterRow(row(y == 1 ? 1 : y - 2), row(y - 1), row(y), dstp + dstStride * (y - 1), dstWidth, plane, &data->cas);
+
+            if (y == dstHeight - 1)
+                data->cas.filterRow(row(y - 1), row(y), row(y - 1), dstp + dstStride * y, dstWidth, plane, &data->cas);
+        };
+
+        for (int y = 0; y < srcHeight; y++) {
+            for (int k = 0; k < numOutputs; k++) {
+                const CASTaps & columns = data->columns[plane][k];
+                const CASTaps & rows = data->rows[plane][k];
+                const int dstWidth = vsapi->getFrameWidth(dst[k], plane);
+                const int dstHeight = vsapi->getFrameHeight(dst[k], plane);
+
+                // Horizontal pass of the source row, kept only while some output row still needs it.
+                if (next[k] < dstHeight && y >= rows.first[next[k]]) {
+                    float * VS_RESTRICT hp = hbuffer[k] + dstWidth * (y % rows.size);
+                    for (int x = 0; x < dstWidth; x++) {
+                        const pixel_t * s = srcp + columns.first[x];
+                        const float * weight = columns.weight.data() + columns.size * x;
+                        float sum = 0.0f;
+                        for (int t = 0; t < columns.size; t++)
+                            sum += s[t] * weight[t];
+                        hp[x] = sum;
+                    }
                 }
 
-                srcp += stride;
-                dstp += stride;
+                while (next[k] < dstHeight && rows.first[next[k]] + rows.size - 1 <= y)
+                    emit(k, next[k]++);
             }
+
+            srcp += srcStride;
         }
     }
 }
 
+static CASTaps downscaleTaps(const int src, const int dst) {
+    // Triangle filter stretched by the scaling ratio, each output sample taking a fixed-size run of source samples starting at first.
+    // Taps falling outside the source are folded onto the edge samples.
+    CASTaps taps;
+    const double ratio = static_cast<double>(src) / dst;
+    std::vector<std::vector<double>> weights(dst);
+    std::vector<int> low(dst);
+
+    taps.size = 1;
+    for (int i = 0; i < dst; i++) {
+        const double center = (i + 0.5) * ratio - 0.5;
+        const int left = static_cast<int>(std::floor(center - ratio)) + 1;
+        const int right = static_cast<int>(std::ceil(center + ratio)) - 1;
+
+        low[i] = std::clamp(left, 0, src - 1);
+        weights[i].assign(std::clamp(right, 0, src - 1) - low[i] + 1, 0.0);
+
+        double total = 0.0;
+        for (int j = left; j <= right; j++) {
+            const double w = std::max(1.0 - std::abs(j - center) / ratio, 0.0);
+            weights[i][std::clamp(j, 0, src - 1) - low[i]] += w;
+            total += w;
+        }
+        for (auto & w : weights[i])
+            w /= total;
+
+        taps.size = std::max(taps.size, static_cast<int>(weights[i].size()));
+    }
+
+    taps.first.resize(dst);
+    taps.weight.assign(static_cast<size_t>(dst) * taps.size, 0.0f);
+
+    for (int i = 0; i < dst; i++) {
+        taps.first[i] = std::min(low[i], src - taps.size);
+        for (size_t j = 0; j < weights[i].size(); j++)
+            taps.weight[static_cast<size_t>(i) * taps.size + low[i] - taps.first[i] + j] = static_cast<float>(weights[i][j]);
+    }
+
+    return taps;
+}
+
+static void configure(CASData * d, const int linear, const int opt) {
+    CASConfig config;
+    cas_default_config(&config, d->vi->width - d->crop[0] - d->crop[2], d->vi->height - d->crop[1] - d->crop[3], d->vi->format->numPlanes, d->vi->format->subSamplingW, d->vi->format->subSamplingH,
+                       d->vi->format->bitsPerSample, d->vi->format->sampleType == stFloat, d->vi->format->colorFamily == cmRGB);
+    config.planes = d->process[0] | d->process[1] << 1 | d->process[2] << 2;
+    config.sharpness = d->sharpness;
+    config.shared_amp = d->sharedAmp;
+    config.amp_scale = d->ampScale;
+    config.fields = d->fields;
+    config.linear = linear;
+    if (d->upscale) {
+        config.dst_width = d->dstVi.width;
+        config.dst_height = d->dstVi.height;
+    }
+    config.padded = 1;
+    config.opt = opt;
+    config.huge_pages = d->hugePages;
+
+    casConfigure(d, config);
+    d->config = config;
+
+    if (d->vi->format->bytesPerSample == 1) {
+        d->filterRegion = filterRegion<uint8_t>;
+        d->filterBlocks = filterBlocks<uint8_t>;
+        d->findBorders = findBorders<uint8_t>;
+        d->fillPadding = fillPadding<uint8_t>;
+    } else if (d->vi->format->bytesPerSample == 2) {
+        d->filterRegion = filterRegion<uint16_t>;
+        d->filterBlocks = filterBlocks<uint16_t>;
+        d->findBorders = findBorders<uint16_t>;
+        d->fillPadding = fillPadding<uint16_t>;
+    } else {
+        d->filterRegion = filterRegion<float>;
+        d->filterBlocks = filterBlocks<float>;
+        d->findBorders = findBorders<float>;
+        d->fillPadding = fillPadding<float>;
+    }
+}
+
+static CASPlanes sourcePlanes(const VSFrameRef * src, const CASData * d, const VSAPI * vsapi) noexcept {
+    // With crop the kernels start at the region's first sample and only read the rows and columns inside it. Such rows are neither aligned
+    // nor padded, so only the plain kernel, which copies each row, and the row kernels are used on them.
+    CASPlanes planes = {};
+    for (int plane = 0; plane < d->vi->format->numPlanes; plane++) {
+        const int ssw = plane ? d->vi->format->subSamplingW : 0;
+        const int ssh = plane ? d->vi->format->subSamplingH : 0;
+        planes.srcStride[plane] = vsapi->getStride(src, plane) / d->vi->format->bytesPerSample;
+        planes.srcp[plane] = vsapi->getReadPtr(src, plane) + ((d->crop[1] >> ssh) * planes.srcStride[plane] + (d->crop[0] >> ssw)) * d->vi->format->bytesPerSample;
+        planes.width[plane] = d->width[plane];
+        planes.height[plane] = d->height[plane];
+    }
+
+    return planes;
+}
+
+static void setStats(VSFrameRef * dst, const CASStats & stats, const VSAPI * vsapi) noexcept {
+    VSMap * props = vsapi->getFramePropsRW(dst);
+    const double count = static_cast<double>(stats.count);
+
+    vsapi->propSetFloat(props, "CASMeanAmp", stats.ampSum / count, paReplace);
+
+    double histogram[8];
+    for (int bin = 0; bin < 8; bin++)
+        histogram[bin] = stats.histogram[bin] / count;
+    vsapi->propSetFloatArray(props, "CASAmpHistogram", histogram, 8);
+
+    vsapi->propSetFloat(props, "CASClipped", stats.clipped / count, paReplace);
+
+    vsapi->propSetInt(props, "CASScratchPeak", static_cast<int64_t>(casScratchPeak()), paReplace);
+}
+
+static CASStats filterFrame(const VSFrameRef * src, VSFrameRef * dst, const CASKernel * kernel, const CASData * d, const VSAPI * vsapi) noexcept {
+    // Planes that are not written are left alone, since asking for a write pointer would detach a plane shared with the source.
+    CASPlanes planes = sourcePlanes(src, d, vsapi);
+    for (int plane = 0; plane < d->vi->format->numPlanes; plane++) {
+        planes.dstWidth[plane] = d->cropPad ? d->width[plane] : vsapi->getFrameWidth(dst, plane);
+        planes.dstHeight[plane] = d->cropPad ? d->height[plane] : vsapi->getFrameHeight(dst, plane);
+
+        if (d->upscale || d->process[plane]) {
+            planes.dstp[plane] = vsapi->getWritePtr(dst, plane);
+            planes.dstStride[plane] = vsapi->getStride(dst, plane) / d->vi->format->bytesPerSample;
+        }
+    }
+
+    CASStats stats = {};
+    if (d->stats || d->autoSharpness)
+        planes.stats = &stats;
+
+    casFilter(planes, kernel);
+
+    if (d->cropPad)
+        d->fillPadding(src, dst, d, vsapi);
+
+    if (d->stats)
+        setStats(dst, stats, vsapi);
+
+    return stats;
+}
+
+static std::array<uint64_t, 2> hashFrame(const VSFrameRef * frame, const VSAPI * vsapi) noexcept {
+    // xxh3-style accumulation: eight independent 64-bit lanes per 64 byte stripe, each adding the 32x32->64 product of the keyed input
+    // halves plus the neighbouring input, which the compiler turns into vector multiplies.
+    static constexpr uint64_t secret[8] = {
+        0xbe4ba423396cfeb8, 0x1cad21f72c81017c, 0xdb979083e96dd4de, 0x1f67b3b7a4a44072,
+        0x78e5c0cc4ee679cb, 0x2172ffcc7dd05a82, 0x8e2443f7744608b8, 0x4c263a81e69035e0
+    };
+
+    uint64_t acc[8] = {
+        0x00000000c2b2ae3d, 0x9e3779b185ebca87, 0xc2b2ae3d27d4eb4f, 0x165667b19e3779f9,
+        0x85ebca77c2b2ae63, 0x0000000085ebca77, 0x27d4eb2f165667c5, 0x000000009e3779b1
+    };
+
+    auto accumulate = [&](const uint8_t * p) noexcept {
+        uint64_t data[8];
+        std::memcpy(data, p, sizeof(data));
+        for (int i = 0; i < 8; i++) {
+            const uint64_t keyed = data[i] ^ secret[i];
+            acc[i ^ 1] += data[i];
+            acc[i] += (keyed & 0xffffffff) * (keyed >> 32);
+        }
+    };
+
+    for (int plane = 0; plane < vsapi->getFrameFormat(frame)->numPlanes; plane++) {
+        const int rowSize = vsapi->getFrameWidth(frame, plane) * vsapi->getFrameFormat(frame)->bytesPerSample;
+        const int height = vsapi->getFrameHeight(frame, plane);
+        const int stride = vsapi->getStride(frame, plane);
+        const uint8_t * srcp = vsapi->getReadPtr(frame, plane);
+
+        for (int y = 0; y < height; y++) {
+            int x = 0;
+            for (; x + 64 <= rowSize; x += 64)
+                accumulate(srcp + x);
+
+            if (x < rowSize) {
+                uint8_t tail[64] = {};
+                std::memcpy(tail, srcp + x, rowSize - x);
+                accumulate(tail);
+            }
+
+            // Scramble between rows so that the same samples in a different layout hash differently.
+            for (int i = 0; i < 8; i++)
+                acc[i] = (acc[i] ^ (acc[i] >> 47) ^ secret[i]) * 0x9e3779b1;
+
+            srcp += stride;
+        }
+    }
+
+    // Two differently paired merges of the lanes give a 128-bit key, making an accidental match between different frames negligible.
+    auto merge = [&](const int offset) noexcept {
+        uint64_t hash = 0;
+        for (int i = 0; i < 8; i += 2) {
+            const uint64_t a = acc[(i + offset) & 7] ^ secret[i];
+            const uint64_t b = acc[(i + offset + 1) & 7] ^ secret[i + 1];
+            hash += ((a & 0xffffffff) * (b >> 32)) ^ ((a >> 32) * (b & 0xffffffff)) ^ (a * b);
+        }
+
+        hash ^= hash >> 37;
+        hash *= 0x165667919e3779f9;
+        return hash ^ (hash >> 32);
+    };
+
+    return { merge(0), merge(1) };
+}
+
+static bool equalPlanes(const VSFrameRef * a, const VSFrameRef * b, const int plane, const VSAPI * vsapi) noexcept {
+    const int rowSize = vsapi->getFrameWidth(a, plane) * vsapi->getFrameFormat(a)->bytesPerSample;
+    const int height = vsapi->getFrameHeight(a, plane);
+    const int strideA = vsapi->getStride(a, plane);
+    const int strideB = vsapi->getStride(b, plane);
+    const uint8_t * ap = vsapi->getReadPtr(a, plane);
+    const uint8_t * bp = vsapi->getReadPtr(b, plane);
+
+    for (int y = 0; y < height; y++) {
+        if (std::memcmp(ap + y * strideA, bp + y * strideB, rowSize))
+            return false;
+    }
+
+    return true;
+}
+
 static void VS_CC casInit(VSMap * in, VSMap * out, void ** instanceData, VSNode * node, VSCore * core, const VSAPI * vsapi) {
     CASData * d = static_cast<CASData *>(*instanceData);
-    vsapi->setVideoInfo(d->vi, 1, node);
+    vsapi->setVideoInfo(&d->dstVi, 1, node);
+}
+
+static void findRegion(const VSFrameRef * src, int * roi, const CASData * d, const VSAPI * vsapi) {
+    std::copy_n(d->roi, 4, roi);
+    if (d->autocrop) {
+        // Each frame's rectangle comes from its own borders, so it does not depend on which frames were requested before it.
+        int borders[4];
+        d->findBorders(src, borders, d, vsapi);
+
+        for (int i = 0; i < 4; i++)
+            roi[i] = std::max(roi[i], borders[i]);
+    }
+}
+
+static std::array<uint64_t, 2> cacheKey(const std::array<uint64_t, 2> & hash, const int * roi, const CASData * d) noexcept {
+    uint32_t sharpness;
+    std::memcpy(&sharpness, &d->sharpness, sizeof(sharpness));
+
+    uint32_t padValue = 0;
+    for (int plane = 0; plane < 3; plane++) {
+        uint32_t bits;
+        std::memcpy(&bits, &d->padValue[plane], sizeof(bits));
+        padValue = padValue * 0x01000193 ^ bits;
+    }
+
+    // Everything that affects the output besides the source itself. Bump the first value whenever the filter's results change.
+    const uint64_t params[] = {
+        4,
+        static_cast<uint64_t>(d->vi->format->id),
+        static_cast<uint64_t>(d->dstVi.width) << 32 | static_cast<uint32_t>(d->dstVi.height),
+        sharpness,
+        static_cast<uint64_t>(d->process[0] | d->process[1] << 1 | d->process[2] << 2 | d->sharedAmp << 3 | (d->ampScale - 1) << 4 |
+                              d->fields << 5 | d->config.linear << 6 | d->isa << 8),
+        static_cast<uint64_t>(roi[0]) << 32 | static_cast<uint32_t>(roi[1]),
+        static_cast<uint64_t>(roi[2]) << 32 | static_cast<uint32_t>(roi[3]),
+        static_cast<uint64_t>(d->crop[0]) << 32 | static_cast<uint32_t>(d->crop[1]),
+        static_cast<uint64_t>(d->crop[2]) << 32 | static_cast<uint32_t>(d->crop[3]),
+        static_cast<uint64_t>(d->padConstant) << 32 | padValue
+    };
+
+    std::array<uint64_t, 2> key = hash;
+    for (const auto param : params) {
+        for (int i = 0; i < 2; i++) {
+            uint64_t x = key[i] ^ param ^ (i ? 0xc2b2ae3d27d4eb4f : 0x9e3779b97f4a7c15);
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+            key[i] = x ^ (x >> 31);
+        }
+    }
+
+    return key;
+}
+
+static VSFrameRef * newFrame(const VSFrameRef * src, const CASData * d, VSCore * core, const VSAPI * vsapi) {
+    // Planes that are only copied share the source's, unless the output has dimensions of its own.
+    if (d->upscale || d->cropPad)
+        return vsapi->newVideoFrame(d->dstVi.format, d->dstVi.width, d->dstVi.height, src, core);
+
+    const VSFrameRef * fr[] = { d->process[0] ? nullptr : src, d->process[1] ? nullptr : src, d->process[2] ? nullptr : src };
+    const int pl[] = { 0, 1, 2 };
+    return vsapi->newVideoFrame2(d->vi->format, d->vi->width, d->vi->height, fr, pl, src, core);
+}
+
+static VSFrameRef * processFrame(const VSFrameRef * src, const int * roi, CASData * d, VSCore * core, const VSAPI * vsapi) {
+    VSFrameRef * dst;
+    if (d->analyzeOnly) {
+        // The copy shares the source's planes, so only the properties are new.
+        dst = vsapi->copyFrame(src, core);
+
+        CASStats stats = {};
+        casAnalyze(sourcePlanes(src, d, vsapi), d, &stats);
+        setStats(dst, stats, vsapi);
+
+        return dst;
+    }
+
+    if (roi[0] || roi[1] || roi[2] || roi[3]) {
+        const VSFrameRef * fr[] = { d->process[0] ? nullptr : src, d->process[1] ? nullptr : src, d->process[2] ? nullptr : src };
+        const int pl[] = { 0, 1, 2 };
+        dst = vsapi->newVideoFrame2(d->vi->format, d->vi->width, d->vi->height, fr, pl, src, core);
+
+        d->filterRegion(src, dst, roi, d, vsapi);
+
+        return dst;
+    }
+
+    if (d->blockSkip) {
+        const VSFrameRef * previousSrc = nullptr;
+        const VSFrameRef * previousDst = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(d->previousMutex);
+            if (d->previousSrc) {
+                previousSrc = vsapi->cloneFrameRef(d->previousSrc);
+                previousDst = vsapi->cloneFrameRef(d->previousDst);
+            }
+        }
+
+        // Whole planes that did not change are taken from the previous output without copying.
+        bool reused[3] = {};
+        const VSFrameRef * fr[] = { d->process[0] ? nullptr : src, d->process[1] ? nullptr : src, d->process[2] ? nullptr : src };
+        const int pl[] = { 0, 1, 2 };
+        for (int plane = 0; plane < d->vi->format->numPlanes && previousSrc; plane++) {
+            if (d->process[plane] && equalPlanes(src, previousSrc, plane, vsapi)) {
+                reused[plane] = true;
+                fr[plane] = previousDst;
+            }
+        }
+        dst = vsapi->newVideoFrame2(d->vi->format, d->vi->width, d->vi->height, fr, pl, src, core);
+
+        float hitRate = 0.0f;
+        if (previousSrc)
+            hitRate = d->filterBlocks(src, dst, previousSrc, previousDst, reused, d, vsapi);
+        else
+            filterFrame(src, dst, d, d, vsapi);
+
+        vsapi->propSetFloat(vsapi->getFramePropsRW(dst), "CASBlockHitRate", hitRate, paReplace);
+
+        vsapi->freeFrame(previousSrc);
+        vsapi->freeFrame(previousDst);
+
+        // The most recently finished frame becomes the reference for the next one, whichever order frames are requested in.
+        {
+            std::lock_guard<std::mutex> lock(d->previousMutex);
+            previousSrc = d->previousSrc;
+            previousDst = d->previousDst;
+            d->previousSrc = vsapi->cloneFrameRef(src);
+            d->previousDst = vsapi->cloneFrameRef(dst);
+        }
+
+        vsapi->freeFrame(previousSrc);
+        vsapi->freeFrame(previousDst);
+        return dst;
+    }
+
+    dst = newFrame(src, d, core, vsapi);
+    filterFrame(src, dst, d, d, vsapi);
+
+    return dst;
+}
+
+// Sharpness of frame n from the mean amplitude of up to auto_radius previous frames of its scene. Frames are measured while they are
+// sharpened themselves, or on demand when they have not been yet, so the result does not depend on the order frames are requested in.
+// The first frame of a scene has no previous frames and is measured before it is sharpened.
+static VSFrameRef * autoFrame(const int n, const VSFrameRef * src, CASData * d, VSFrameContext * frameCtx, VSCore * core, const VSAPI * vsapi) {
+    auto remember = [&](const int k, const CASStats & stats) {
+        const float amp = static_cast<float>(stats.ampSum / stats.count);
+        std::lock_guard<std::mutex> lock(d->autoMutex);
+        d->measured[k] = amp;
+        while (d->measured.size() > 1024)
+            d->measured.erase(d->measured.begin());
+        return amp;
+    };
+
+    auto measure = [&](const int k, const VSFrameRef * frame) {
+        {
+            std::lock_guard<std::mutex> lock(d->autoMutex);
+            const auto it = d->measured.find(k);
+            if (it != d->measured.end())
+                return it->second;
+        }
+
+        CASStats stats = {};
+        casAnalyze(sourcePlanes(frame, d, vsapi), d, &stats);
+        return remember(k, stats);
+    };
+
+    int err;
+    bool sceneStart = !!vsapi->propGetInt(vsapi->getFramePropsRO(src), "_SceneChangePrev", 0, &err);
+    float sum = 0.0f;
+    int count = 0;
+    for (int k = n - 1; k >= std::max(n - d->autoRadius, 0) && !sceneStart; k--) {
+        const VSFrameRef * frame = vsapi->getFrameFilter(k, d->node, frameCtx);
+        const VSMap * props = vsapi->getFramePropsRO(frame);
+
+        if (!vsapi->propGetInt(props, "_SceneChangeNext", 0, &err)) {
+            sum += measure(k, frame);
+            count++;
+            sceneStart = !!vsapi->propGetInt(props, "_SceneChangePrev", 0, &err);
+        } else {
+            sceneStart = true;
+        }
+
+        vsapi->freeFrame(frame);
+    }
+
+    if (!count) {
+        sum = measure(n, src);
+        count = 1;
+    }
+
+    // The curve's points are pairs of mean amplitude and sharpness, with the sharpness held beyond the first and last points.
+    const float amp = sum / count;
+    const std::vector<float> & curve = d->autoCurve;
+    float sharpness = curve[1];
+    for (size_t i = 0; i < curve.size(); i += 2) {
+        if (amp >= curve[i])
+            sharpness = i + 2 < curve.size() ? curve[i + 1] + (curve[i + 3] - curve[i + 1]) * std::min((amp - curve[i]) / (curve[i + 2] - curve[i]), 1.0f) : curve[i + 1];
+    }
+
+    // Kernels are configured on first use for each step of 0.01.
+    const int step = static_cast<int>(std::lrint(sharpness * 100.0f));
+    const CASKernel * kernel;
+    {
+        std::lock_guard<std::mutex> lock(d->autoMutex);
+        std::unique_ptr<CASKernel> & variant = d->autoKernels[step];
+        if (!variant) {
+            CASConfig config = d->config;
+            config.sharpness = step / 100.0f;
+            variant = std::make_unique<CASKernel>();
+            casConfigure(variant.get(), config);
+        }
+        kernel = variant.get();
+    }
+
+    VSFrameRef * dst = newFrame(src, d, core, vsapi);
+    remember(n, filterFrame(src, dst, kernel, d, vsapi));
+    vsapi->propSetFloat(vsapi->getFramePropsRW(dst), "CASAutoSharpness", step / 100.0, paReplace);
+
+    return dst;
+}
+
+// Copies the properties the filter sets on its output, all named CAS..., to a frame made from a remembered output.
+static void copyOutputProps(const VSFrameRef * from, VSFrameRef * to, const VSAPI * vsapi) noexcept {
+    const VSMap * src = vsapi->getFramePropsRO(from);
+    VSMap * dst = vsapi->getFramePropsRW(to);
+    for (int i = 0; i < vsapi->propNumKeys(src); i++) {
+        const char * key = vsapi->propGetKey(src, i);
+        if (std::strncmp(key, "CAS", 3))
+            continue;
+
+        int err;
+        vsapi->propDeleteKey(dst, key);
+        if (vsapi->propGetType(src, key) == ptInt)
+            vsapi->propSetIntArray(dst, key, vsapi->propGetIntArray(src, key, &err), vsapi->propNumElements(src, key));
+        else if (vsapi->propGetType(src, key) == ptFloat)
+            vsapi->propSetFloatArray(dst, key, vsapi->propGetFloatArray(src, key, &err), vsapi->propNumElements(src, key));
+    }
 }
 
 static const VSFrameRef * VS_CC casGetFrame(int n, int activationReason, void ** instanceData, void ** frameData, VSFrameContext * frameCtx, VSCore * core, const VSAPI * vsapi) {
-    const CASData * d = static_cast<const CASData *>(*instanceData);
+    CASData * d = static_cast<CASData *>(*instanceData);
 
     if (activationReason == arInitial) {
+        if (d->autoSharpness) {
+            for (int k = std::max(n - d->autoRadius, 0); k < n; k++)
+                vsapi->requestFrameFilter(k, d->node, frameCtx);
+        }
+
         vsapi->requestFrameFilter(n, d->node, frameCtx);
     } else if (activationReason == arAllFramesReady) {
         const VSFrameRef * src = vsapi->getFrameFilter(n, d->node, frameCtx);
-        const VSFrameRef * fr[] = { d->process[0] ? nullptr : src, d->process[1] ? nullptr : src, d->process[2] ? nullptr : src };
-        const int pl[] = { 0, 1, 2 };
-        VSFrameRef * dst = vsapi->newVideoFrame2(d->vi->format, d->vi->width, d->vi->height, fr, pl, src, core);
 
-        d->filter(src, dst, d, vsapi);
+        std::array<uint64_t, 2> hash = {};
+        if (d->memoSize || d->cache)
+            hash = hashFrame(src, vsapi);
+
+        int roi[4];
+        findRegion(src, roi, d, vsapi);
+
+        if (d->memoSize) {
+            // A source with the same content and rectangle as a remembered one shares that output's planes and the properties the filter set on
+            // it; the other frame properties come from the new source.
+            const VSFrameRef * memo = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(d->memoMutex);
+                for (auto it = d->memo.begin(); it != d->memo.end(); ++it) {
+                    if (it->hash == hash && std::equal(roi, roi + 4, it->roi)) {
+                        d->memo.splice(d->memo.begin(), d->memo, it);
+                        memo = vsapi->cloneFrameRef(it->dst);
+                        break;
+                    }
+                }
+            }
+
+            if (memo) {
+                const VSFrameRef * fr[] = { memo, memo, memo };
+                const int pl[] = { 0, 1, 2 };
+                VSFrameRef * dst = vsapi->newVideoFrame2(vsapi->getFrameFormat(memo), vsapi->getFrameWidth(memo, 0), vsapi->getFrameHeight(memo, 0), fr, pl, src, core);
+                copyOutputProps(memo, dst, vsapi);
+                vsapi->freeFrame(memo);
+                vsapi->freeFrame(src);
+                return dst;
+            }
+        }
+
+        VSFrameRef * dst = nullptr;
+        std::array<uint64_t, 2> key;
+        if (d->cache) {
+            key = cacheKey(hash, roi, d);
+            dst = newFrame(src, d, core, vsapi);
+
+            if (!d->cache->read(key, dst, d->cached, vsapi)) {
+                vsapi->freeFrame(dst);
+                dst = nullptr;
+            }
+        }
+
+        if (!dst) {
+            dst = d->autoSharpness ? autoFrame(n, src, d, frameCtx, core, vsapi) : processFrame(src, roi, d, core, vsapi);
+
+            if (d->cache)
+                d->cache->write(key, dst, d->cached, vsapi);
+        }
+
+        if (d->memoSize) {
+            std::lock_guard<std::mutex> lock(d->memoMutex);
+            d->memo.push_front({ hash, { roi[0], roi[1], roi[2], roi[3] }, vsapi->cloneFrameRef(dst) });
+            while (static_cast<int>(d->memo.size()) > d->memoSize) {
+                vsapi->freeFrame(d->memo.back().dst);
+                d->memo.pop_back();
+            }
+        }
 
         vsapi->freeFrame(src);
         return dst;
@@ -160,6 +915,10 @@ static const VSFrameRef * VS_CC casGetFrame(int n, int activationReason, void **
 
 static void VS_CC casFree(void * instanceData, VSCore * core, const VSAPI * vsapi) {
     CASData * d = static_cast<CASData *>(instanceData);
+    for (auto & memo : d->memo)
+        vsapi->freeFrame(memo.dst);
+    vsapi->freeFrame(d->previousSrc);
+    vsapi->freeFrame(d->previousDst);
     vsapi->freeNode(d->node);
     delete d;
 }
@@ -191,6 +950,82 @@ static void VS_CC casCreate(const VSMap * in, VSMap * out, void * userData, VSCo
         if (err)
             d->sharpness = 0.5f;
 
+        d->sharedAmp = !!vsapi->propGetInt(in, "shared_amp", 0, &err);
+
+        d->ampScale = int64ToIntS(vsapi->propGetInt(in, "amp_scale", 0, &err));
+        if (err)
+            d->ampScale = 1;
+
+        d->fields = !!vsapi->propGetInt(in, "fields", 0, &err);
+
+        const bool linear = !!vsapi->propGetInt(in, "linear", 0, &err);
+
+        const char * transfer = vsapi->propGetData(in, "transfer", 0, &err);
+        if (err)
+            transfer = "709";
+
+        d->roi[0] = int64ToIntS(vsapi->propGetInt(in, "left", 0, &err));
+        d->roi[1] = int64ToIntS(vsapi->propGetInt(in, "top", 0, &err));
+        d->roi[2] = int64ToIntS(vsapi->propGetInt(in, "right", 0, &err));
+        d->roi[3] = int64ToIntS(vsapi->propGetInt(in, "bottom", 0, &err));
+
+        const int numCrop = vsapi->propNumElements(in, "crop");
+        if (numCrop == 4) {
+            for (int i = 0; i < 4; i++)
+                d->crop[i] = int64ToIntS(vsapi->propGetInt(in, "crop", i, nullptr));
+        }
+
+        d->pad = int64ToIntS(vsapi->propGetInt(in, "pad", 0, &err));
+        if (err)
+            d->pad = 1;
+
+        const int numPadValue = vsapi->propNumElements(in, "pad_value");
+        d->padConstant = numPadValue > 0;
+        for (int plane = 0; plane < 3 && d->padConstant; plane++)
+            d->padValue[plane] = static_cast<float>(vsapi->propGetFloat(in, "pad_value", std::min(plane, numPadValue - 1), nullptr));
+
+        d->autocrop = !!vsapi->propGetInt(in, "autocrop", 0, &err);
+
+        d->blockSkip = !!vsapi->propGetInt(in, "block_skip", 0, &err);
+
+        d->analyzeOnly = !!vsapi->propGetInt(in, "analyze_only", 0, &err);
+
+        d->stats = !!vsapi->propGetInt(in, "stats", 0, &err) || d->analyzeOnly;
+
+        d->autoSharpness = !!vsapi->propGetInt(in, "auto", 0, &err);
+
+        const int numAutoCurve = vsapi->propNumElements(in, "auto_curve");
+        if (numAutoCurve > 0) {
+            for (int i = 0; i < numAutoCurve; i++)
+                d->autoCurve.push_back(static_cast<float>(vsapi->propGetFloat(in, "auto_curve", i, nullptr)));
+        } else {
+            d->autoCurve = { 0.5f, 0.2f, 0.9f, 0.8f };
+        }
+
+        d->autoRadius = int64ToIntS(vsapi->propGetInt(in, "auto_radius", 0, &err));
+        if (err)
+            d->autoRadius = 5;
+
+        d->memoSize = int64ToIntS(vsapi->propGetInt(in, "memo", 0, &err));
+
+        const char * cacheDir = vsapi->propGetData(in, "cache_dir", 0, &err);
+
+        int64_t cacheSize = vsapi->propGetInt(in, "cache_size", 0, &err);
+        if (err)
+            cacheSize = 4096;
+
+        d->hugePages = !!vsapi->propGetInt(in, "huge_pages", 0, &err);
+
+        d->dstVi = *d->vi;
+
+        d->dstVi.width = int64ToIntS(vsapi->propGetInt(in, "width", 0, &err));
+        if (err)
+            d->dstVi.width = d->vi->width;
+
+        d->dstVi.height = int64ToIntS(vsapi->propGetInt(in, "height", 0, &err));
+        if (err)
+            d->dstVi.height = d->vi->height;
+
         {
             const int m = vsapi->propNumElements(in, "planes");
 
@@ -220,52 +1055,171 @@ static void VS_CC casCreate(const VSMap * in, VSMap * out, void * userData, VSCo
         if (d->sharpness < 0.0f || d->sharpness > 1.0f)
             throw "sharpness must be between 0.0 and 1.0 (inclusive)";
 
+        if (d->dstVi.width < d->vi->width || d->dstVi.height < d->vi->height)
+            throw "width and height must be greater than or equal to the clip's dimensions";
+
+        if (d->roi[0] < 0 || d->roi[1] < 0 || d->roi[2] < 0 || d->roi[3] < 0)
+            throw "left, top, right and bottom must be greater than or equal to 0";
+
+        if ((d->roi[0] | d->roi[2]) % (1 << d->vi->format->subSamplingW) || (d->roi[1] | d->roi[3]) % (1 << d->vi->format->subSamplingH))
+            throw "left, top, right and bottom must be mod subsampling";
+
+        for (int plane = 0; plane < d->vi->format->numPlanes; plane++) {
+            const int ssw = plane ? d->vi->format->subSamplingW : 0;
+            const int ssh = plane ? d->vi->format->subSamplingH : 0;
+
+            if ((d->vi->width - d->roi[0] - d->roi[2]) >> ssw < 3 || (d->vi->height - d->roi[1] - d->roi[3]) >> ssh < 3)
+                throw "region's width and height must be greater than or equal to 3";
+        }
+
+        if (numCrop > 0 && numCrop != 4)
+            throw "crop must contain left, top, right and bottom";
+
+        if (d->crop[0] < 0 || d->crop[1] < 0 || d->crop[2] < 0 || d->crop[3] < 0)
+            throw "crop must be greater than or equal to 0";
+
+        if ((d->crop[0] | d->crop[2]) % (1 << d->vi->format->subSamplingW) || (d->crop[1] | d->crop[3]) % (1 << d->vi->format->subSamplingH))
+            throw "crop must be mod subsampling";
+
+        for (int plane = 0; plane < d->vi->format->numPlanes; plane++) {
+            const int ssw = plane ? d->vi->format->subSamplingW : 0;
+            const int ssh = plane ? d->vi->format->subSamplingH : 0;
+
+            if ((d->vi->width - d->crop[0] - d->crop[2]) >> ssw < 3 || (d->vi->height - d->crop[1] - d->crop[3]) >> ssh < 3)
+                throw "cropped width and height must be greater than or equal to 3";
+        }
+
+        if (d->pad < 1)
+            throw "pad must be greater than or equal to 1";
+
+        if (numPadValue > d->vi->format->numPlanes)
+            throw "pad_value has more values than the clip has planes";
+
+        if (d->vi->format->sampleType == stInteger) {
+            for (int plane = 0; plane < 3; plane++) {
+                if (d->padValue[plane] < 0.0f || d->padValue[plane] > static_cast<float>((1 << d->vi->format->bitsPerSample) - 1))
+                    throw "pad_value must be between 0 and the format's peak value";
+
+                d->padValue[plane] = std::round(d->padValue[plane]);
+            }
+        }
+
+        if (d->ampScale != 1 && d->ampScale != 2)
+            throw "amp_scale must be 1 or 2";
+
+        if (d->autoCurve.size() < 2 || d->autoCurve.size() % 2)
+            throw "auto_curve must contain pairs of mean amplitude and sharpness";
+
+        for (size_t i = 0; i < d->autoCurve.size(); i += 2) {
+            if (i && d->autoCurve[i] <= d->autoCurve[i - 2])
+                throw "auto_curve's mean amplitudes must be increasing";
+
+            if (d->autoCurve[i + 1] < 0.0f || d->autoCurve[i + 1] > 1.0f)
+                throw "auto_curve's sharpness must be between 0.0 and 1.0 (inclusive)";
+        }
+
+        if (d->autoRadius < 1)
+            throw "auto_radius must be greater than or equal to 1";
+
+        if (d->memoSize < 0)
+            throw "memo must be greater than or equal to 0";
+
+        if (cacheSize < 1)
+            throw "cache_size must be greater than or equal to 1";
+
         if (opt < 0 || opt > 4)
             throw "opt must be 0, 1, 2, 3, or 4";
 
+        d->upscale = d->dstVi.width != d->vi->width || d->dstVi.height != d->vi->height;
+
+        // The output of crop and pad is the cropped region, extended at the right and bottom to the next multiple of pad.
         {
-            if (d->vi->format->bytesPerSample == 1)
-                d->filter = filter_c<uint8_t>;
-            else if (d->vi->format->bytesPerSample == 2)
-                d->filter = filter_c<uint16_t>;
-            else
-                d->filter = filter_c<float>;
-
-#ifdef CAS_X86
-            const int iset = instrset_detect();
-            if ((opt == 0 && iset >= 10) || opt == 4) {
-                if (d->vi->format->bytesPerSample == 1)
-                    d->filter = filter_avx512<uint8_t>;
-                else if (d->vi->format->bytesPerSample == 2)
-                    d->filter = filter_avx512<uint16_t>;
-                else
-                    d->filter = filter_avx512<float>;
-            } else if ((opt == 0 && iset >= 8) || opt == 3) {
-                if (d->vi->format->bytesPerSample == 1)
-                    d->filter = filter_avx2<uint8_t>;
-                else if (d->vi->format->bytesPerSample == 2)
-                    d->filter = filter_avx2<uint16_t>;
-                else
-                    d->filter = filter_avx2<float>;
-            } else if ((opt == 0 && iset >= 2) || opt == 2) {
-                if (d->vi->format->bytesPerSample == 1)
-                    d->filter = filter_sse2<uint8_t>;
-                else if (d->vi->format->bytesPerSample == 2)
-                    d->filter = filter_sse2<uint16_t>;
-                else
-                    d->filter = filter_sse2<float>;
+            const int croppedWidth = d->vi->width - d->crop[0] - d->crop[2];
+            const int croppedHeight = d->vi->height - d->crop[1] - d->crop[3];
+            const int paddedWidth = (croppedWidth + d->pad - 1) / d->pad * d->pad;
+            const int paddedHeight = (croppedHeight + d->pad - 1) / d->pad * d->pad;
+
+            d->cropPad = d->crop[0] || d->crop[1] || d->crop[2] || d->crop[3] || paddedWidth != d->vi->width || paddedHeight != d->vi->height;
+
+            if (d->cropPad) {
+                if (paddedWidth % (1 << d->vi->format->subSamplingW) || paddedHeight % (1 << d->vi->format->subSamplingH))
+                    throw "padded width and height must be mod subsampling";
+
+                if (d->roi[0] || d->roi[1] || d->roi[2] || d->roi[3] || d->autocrop || d->blockSkip)
+                    throw "crop and pad are not supported with left, top, right, bottom, autocrop or block_skip";
+
+                if (d->upscale)
+                    throw "crop and pad are not supported when upscaling";
+
+                // shared_amp and amp_scale read whole vectors straight from the source rows, which a cropped row may end too close to.
+                if ((d->crop[0] || d->crop[1] || d->crop[2] || d->crop[3]) && (d->sharedAmp || d->ampScale == 2))
+                    throw "crop is not supported with shared_amp or amp_scale";
+
+                d->dstVi.width = paddedWidth;
+                d->dstVi.height = paddedHeight;
             }
-#endif
         }
 
-        auto lerp = [](const float a, const float b, const float t) noexcept { return a + (b - a) * t; };
-        d->sharpness = -1.0f / lerp(16.0f, 5.0f, d->sharpness);
+        if (d->sharedAmp && (d->roi[0] || d->roi[1] || d->roi[2] || d->roi[3] || d->autocrop))
+            throw "shared_amp is not supported with left, top, right, bottom or autocrop";
 
-        if (d->vi->format->sampleType == stInteger) {
-            d->limit = (1 << (d->vi->format->bitsPerSample + 1)) - 1;
-            d->peak = (1 << d->vi->format->bitsPerSample) - 1;
-        } else {
-            d->limit = 2.0f;
+        if (d->blockSkip && (d->sharedAmp || d->roi[0] || d->roi[1] || d->roi[2] || d->roi[3] || d->autocrop))
+            throw "block_skip is not supported with shared_amp, left, top, right, bottom or autocrop";
+
+        if (d->ampScale == 2 && (d->sharedAmp || d->roi[0] || d->roi[1] || d->roi[2] || d->roi[3] || d->autocrop || d->blockSkip))
+            throw "amp_scale is not supported with shared_amp, left, top, right, bottom, autocrop or block_skip";
+
+        int linearTransfer = 0;
+        if (linear) {
+            if (!strcmp(transfer, "709"))
+                linearTransfer = 1;
+            else if (!strcmp(transfer, "srgb"))
+                linearTransfer = 2;
+            else if (!strcmp(transfer, "st2084"))
+                linearTransfer = 3;
+            else
+                throw "transfer must be 709, srgb or st2084";
+
+            if (d->roi[0] || d->roi[1] || d->roi[2] || d->roi[3] || d->autocrop || d->blockSkip)
+                throw "linear is not supported with left, top, right, bottom, autocrop or block_skip";
+        }
+
+        if (d->stats && (d->roi[0] || d->roi[1] || d->roi[2] || d->roi[3] || d->autocrop || d->blockSkip || d->memoSize || cacheDir))
+            throw "stats and analyze_only are not supported with left, top, right, bottom, autocrop, block_skip, memo or cache_dir";
+
+        if (d->autoSharpness && (d->roi[0] || d->roi[1] || d->roi[2] || d->roi[3] || d->autocrop || d->blockSkip || d->memoSize || cacheDir || d->analyzeOnly))
+            throw "auto is not supported with left, top, right, bottom, autocrop, block_skip, memo, cache_dir or analyze_only";
+
+        if (d->analyzeOnly && (d->upscale || d->cropPad))
+            throw "analyze_only is not supported with crop, pad or upscaling";
+
+        if (d->fields && (d->roi[0] || d->roi[1] || d->roi[2] || d->roi[3] || d->autocrop || d->blockSkip))
+            throw "fields is not supported with left, top, right, bottom, autocrop or block_skip";
+
+        if (d->upscale) {
+            if (d->dstVi.width % (1 << d->vi->format->subSamplingW) || d->dstVi.height % (1 << d->vi->format->subSamplingH))
+                throw "width and height must be mod subsampling";
+
+            if (d->sharedAmp)
+                throw "shared_amp is not supported when upscaling";
+
+            if (d->roi[0] || d->roi[1] || d->roi[2] || d->roi[3] || d->autocrop)
+                throw "left, top, right, bottom and autocrop are not supported when upscaling";
+
+            if (d->blockSkip)
+                throw "block_skip is not supported when upscaling";
+
+            if (d->ampScale == 2)
+                throw "amp_scale is not supported when upscaling";
+        }
+
+        configure(d.get(), linearTransfer, opt);
+
+        if (cacheDir) {
+            for (int plane = 0; plane < d->vi->format->numPlanes; plane++)
+                d->cached[plane] = d->upscale || d->cropPad || d->process[plane];
+
+            d->cache = std::make_unique<CASCache>(cacheDir, static_cast<uint64_t>(cacheSize) << 20);
         }
     } catch (const char * error) {
         vsapi->setError(out, ("CAS: "s + error).c_str());
@@ -276,6 +1230,196 @@ static void VS_CC casCreate(const VSMap * in, VSMap * out, void * userData, VSCo
     vsapi->createFilter(in, out, "CAS", casInit, casGetFrame, casFree, fmParallel, 0, d.release(), core);
 }
 
+static void VS_CC casLadderInit(VSMap * in, VSMap * out, void ** instanceData, VSNode * node, VSCore * core, const VSAPI * vsapi) {
+    CASLadderData * d = static_cast<CASLadderData *>(*instanceData);
+    vsapi->setVideoInfo(d->vi.data(), static_cast<int>(d->vi.size()), node);
+}
+
+static const VSFrameRef * VS_CC casLadderGetFrame(int n, int activationReason, void ** instanceData, void ** frameData, VSFrameContext * frameCtx, VSCore * core, const VSAPI * vsapi) {
+    CASLadderData * d = static_cast<CASLadderData *>(*instanceData);
+    const int index = vsapi->getOutputIndex(frameCtx);
+
+    // All outputs of a frame are produced together; the ones not asked for yet wait in the cache until their output requests them.
+    auto take = [&]() -> const VSFrameRef * {
+        std::lock_guard<std::mutex> lock(d->mutex);
+        auto it = d->cache.find(n);
+        if (it == d->cache.end() || !it->second[index])
+            return nullptr;
+
+        const VSFrameRef * frame = it->second[index];
+        it->second[index] = nullptr;
+        if (std::all_of(it->second.cbegin(), it->second.cend(), [](const VSFrameRef * f) { return !f; }))
+            d->cache.erase(it);
+        return frame;
+    };
+
+    if (activationReason == arInitial) {
+        if (const VSFrameRef * frame = take())
+            return frame;
+
+        vsapi->requestFrameFilter(n, d->cas.node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        if (const VSFrameRef * frame = take())
+            return frame;
+
+        const VSFrameRef * src = vsapi->getFrameFilter(n, d->cas.node, frameCtx);
+        std::vector<VSFrameRef *> dst(d->vi.size());
+        for (size_t k = 0; k < d->vi.size(); k++)
+            dst[k] = vsapi->newVideoFrame(d->vi[k].format, d->vi[k].width, d->vi[k].height, src, core);
+
+        d->filter(src, dst.data(), d, vsapi);
+
+        vsapi->freeFrame(src);
+
+        {
+            std::lock_guard<std::mutex> lock(d->mutex);
+            auto it = d->cache.find(n);
+            if (it == d->cache.end()) {
+                auto & entry = d->cache[n];
+                entry.assign(dst.cbegin(), dst.cend());
+                entry[index] = nullptr;
+            } else {
+                // Another output ran the ladder for this frame at the same time, so the frame it left for this output is a duplicate that nothing will take.
+                auto & entry = it->second;
+                vsapi->freeFrame(entry[index]);
+                entry[index] = nullptr;
+                if (std::all_of(entry.cbegin(), entry.cend(), [](const VSFrameRef * f) { return !f; }))
+                    d->cache.erase(it);
+
+                for (size_t k = 0; k < dst.size(); k++) {
+                    if (static_cast<int>(k) != index)
+                        vsapi->freeFrame(dst[k]);
+                }
+            }
+
+            // Bound the cache for outputs that are never requested or run far behind the others.
+            while (d->cache.size() > 16) {
+                auto oldest = d->cache.begin()->first != n ? d->cache.begin() : std::prev(d->cache.end());
+                for (auto frame : oldest->second)
+                    vsapi->freeFrame(frame);
+                d->cache.erase(oldest);
+            }
+        }
+
+        return dst[index];
+    }
+
+    return nullptr;
+}
+
+static void VS_CC casLadderFree(void * instanceData, VSCore * core, const VSAPI * vsapi) {
+    CASLadderData * d = static_cast<CASLadderData *>(instanceData);
+    for (auto & entry : d->cache) {
+        for (auto frame : entry.second)
+            vsapi->freeFrame(frame);
+    }
+    vsapi->freeNode(d->cas.node);
+    delete d;
+}
+
+static void VS_CC casLadderCreate(const VSMap * in, VSMap * out, void * userData, VSCore * core, const VSAPI * vsapi) {
+    using namespace std::literals;
+
+    std::unique_ptr<CASLadderData> d = std::make_unique<CASLadderData>();
+
+    try {
+        d->cas.node = vsapi->propGetNode(in, "clip", 0, nullptr);
+        d->cas.vi = vsapi->getVideoInfo(d->cas.node);
+        int err;
+
+        if (!isConstantFormat(d->cas.vi) ||
+            (d->cas.vi->format->sampleType == stInteger && d->cas.vi->format->bitsPerSample > 16) ||
+            (d->cas.vi->format->sampleType == stFloat && d->cas.vi->format->bitsPerSample != 32))
+            throw "only constant format 8-16 bit integer and 32 bit float input supported";
+
+        d->cas.sharpness = static_cast<float>(vsapi->propGetFloat(in, "sharpness", 0, &err));
+        if (err)
+            d->cas.sharpness = 0.5f;
+
+        {
+            const int m = vsapi->propNumElements(in, "planes");
+
+            if (m <= 0) {
+                for (int i = 0; i < 3; i++) {
+                    d->cas.process[i] = true;
+                    if (i == 0 && d->cas.vi->format->colorFamily != cmRGB)
+                        break;
+                }
+            }
+
+            for (int i = 0; i < m; i++) {
+                const int n = int64ToIntS(vsapi->propGetInt(in, "planes", i, nullptr));
+
+                if (n < 0 || n >= d->cas.vi->format->numPlanes)
+                    throw "plane index out of range";
+
+                if (d->cas.process[n])
+                    throw "plane specified twice";
+
+                d->cas.process[n] = true;
+            }
+        }
+
+        const int opt = int64ToIntS(vsapi->propGetInt(in, "opt", 0, &err));
+
+        if (d->cas.sharpness < 0.0f || d->cas.sharpness > 1.0f)
+            throw "sharpness must be between 0.0 and 1.0 (inclusive)";
+
+        if (opt < 0 || opt > 4)
+            throw "opt must be 0, 1, 2, 3, or 4";
+
+        const int numOutputs = vsapi->propNumElements(in, "width");
+        if (numOutputs != vsapi->propNumElements(in, "height"))
+            throw "width and height must have the same number of elements";
+
+        for (int k = 0; k < numOutputs; k++) {
+            VSVideoInfo vi = *d->cas.vi;
+            vi.width = int64ToIntS(vsapi->propGetInt(in, "width", k, nullptr));
+            vi.height = int64ToIntS(vsapi->propGetInt(in, "height", k, nullptr));
+
+            if (vi.width > d->cas.vi->width || vi.height > d->cas.vi->height)
+                throw "width and height must be less than or equal to the clip's dimensions";
+
+            if (vi.width % (1 << vi.format->subSamplingW) || vi.height % (1 << vi.format->subSamplingH))
+                throw "width and height must be mod subsampling";
+
+            for (int plane = 0; plane < vi.format->numPlanes; plane++) {
+                const int ssw = plane ? vi.format->subSamplingW : 0;
+                const int ssh = plane ? vi.format->subSamplingH : 0;
+
+                if (vi.width >> ssw < 3)
+                    throw "plane's width must be greater than or equal to 3";
+
+                if (vi.height >> ssh < 3)
+                    throw "plane's height must be greater than or equal to 3";
+
+                d->columns[plane].push_back(downscaleTaps(d->cas.vi->width >> ssw, vi.width >> ssw));
+                d->rows[plane].push_back(downscaleTaps(d->cas.vi->height >> ssh, vi.height >> ssh));
+            }
+
+            d->vi.push_back(vi);
+        }
+
+        d->cas.ampScale = 1;
+        d->cas.fields = false;
+
+        configure(&d->cas, 0, opt);
+
+        if (d->cas.vi->format->bytesPerSample == 1)
+            d->filter = ladder<uint8_t>;
+        else if (d->cas.vi->format->bytesPerSample == 2)
+            d->filter = ladder<uint16_t>;
+        else
+            d->filter = ladder<float>;
+    } catch (const char * error) {
+        vsapi->setError(out, ("CASLadder: "s + error).c_str());
+        vsapi->freeNode(d->cas.node);
+        return;
+    }
+
+    vsapi->createFilter(in, out, "CASLadder", casLadderInit, casLadderGetFrame, casLadderFree, fmParallel, 0, d.release(), core);
+}
+
 //////////////////////////////////////////
 // Init
 
@@ -285,6 +1429,39 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegiste
                  "clip:clip;"
                  "sharpness:float:opt;"
                  "planes:int[]:opt;"
+                 "shared_amp:int:opt;"
+                 "amp_scale:int:opt;"
+                 "fields:int:opt;"
+                 "linear:int:opt;"
+                 "transfer:data:opt;"
+                 "left:int:opt;"
+                 "top:int:opt;"
+                 "right:int:opt;"
+                 "bottom:int:opt;"
+                 "crop:int[]:opt;"
+                 "pad:int:opt;"
+                 "pad_value:float[]:opt;"
+                 "autocrop:int:opt;"
+                 "block_skip:int:opt;"
+                 "stats:int:opt;"
+                 "analyze_only:int:opt;"
+                 "auto:int:opt;"
+                 "auto_curve:float[]:opt;"
+                 "auto_radius:int:opt;"
+                 "memo:int:opt;"
+                 "cache_dir:data:opt;"
+                 "cache_size:int:opt;"
+                 "huge_pages:int:opt;"
+                 "width:int:opt;"
+                 "height:int:opt;"
                  "opt:int:opt;",
                  casCreate, nullptr, plugin);
+    registerFunc("CASLadder",
+                 "clip:clip;"
+                 "width:int[];"
+                 "height:int[];"
+                 "sharpness:float:opt;"
+                 "planes:int[]:opt;"
+                 "opt:int:opt;",
+                 casLadderCreate, nullptr, plugin);
 }
@@ -1,21 +1,75 @@
 #pragma once
 
-#include <any>
-#include <type_traits>
+#include <array>
+#include <climits>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include <VapourSynth.h>
 #include <VSHelper.h>
 
-#ifdef CAS_X86
-#include "VCL2/vectorclass.h"
-#endif
+#include "CASCache.h"
+#include "CASKernel.h"
 
-struct CASData final {
+struct CASMemo final {
+    std::array<uint64_t, 2> hash;
+    int roi[4];
+    const VSFrameRef * dst;
+};
+
+struct CASData final : CASKernel {
     VSNodeRef * node;
     const VSVideoInfo * vi;
-    float sharpness;
-    bool process[3];
-    std::any limit;
-    int peak;
-    void (*filter)(const VSFrameRef * src, VSFrameRef * dst, const CASData * const VS_RESTRICT data, const VSAPI * vsapi) noexcept;
+    VSVideoInfo dstVi;
+    bool upscale;
+    int crop[4];
+    int pad;
+    bool padConstant;
+    float padValue[3];
+    bool cropPad;
+    bool autocrop;
+    int roi[4];
+    bool blockSkip;
+    bool stats;
+    bool analyzeOnly;
+    bool autoSharpness;
+    std::vector<float> autoCurve;
+    int autoRadius;
+    CASConfig config;
+    std::unique_ptr<CASKernel> autoKernels[101];
+    std::mutex autoMutex;
+    std::map<int, float> measured;
+    const VSFrameRef * previousSrc;
+    const VSFrameRef * previousDst;
+    std::mutex previousMutex;
+    int memoSize;
+    std::list<CASMemo> memo;
+    std::mutex memoMutex;
+    std::unique_ptr<CASCache> cache;
+    bool cached[3];
+    bool hugePages;
+    void (*filterRegion)(const VSFrameRef * src, VSFrameRef * dst, const int * roi, const CASData * const VS_RESTRICT data, const VSAPI * vsapi) noexcept;
+    float (*filterBlocks)(const VSFrameRef * src, VSFrameRef * dst, const VSFrameRef * previousSrc, const VSFrameRef * previousDst, const bool * reused,
+                          const CASData * const VS_RESTRICT data, const VSAPI * vsapi) noexcept;
+    void (*findBorders)(const VSFrameRef * src, int * roi, const CASData * const VS_RESTRICT data, const VSAPI * vsapi) noexcept;
+    void (*fillPadding)(const VSFrameRef * src, VSFrameRef * dst, const CASData * const VS_RESTRICT data, const VSAPI * vsapi) noexcept;
+};
+
+struct CASTaps final {
+    int size;
+    std::vector<int> first;
+    std::vector<float> weight;
+};
+
+struct CASLadderData final {
+    CASData cas;
+    std::vector<VSVideoInfo> vi;
+    std::vector<CASTaps> columns[3], rows[3];
+    std::mutex mutex;
+    std::map<int, std::vector<const VSFrameRef *>> cache;
+    void (*filter)(const VSFrameRef * src, VSFrameRef ** dst, const CASLadderData * const VS_RESTRICT data, const VSAPI * vsapi) noexcept;
 };
@@ -0,0 +1,355 @@
+/*
+    MIT License
+
+    Copyright (c) 2020 Holy Wu
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <cstring>
+
+#include <algorithm>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <VSHelper.h>
+
+#include "CASCache.h"
+
+struct CASCache::Header {
+    char magic[8];
+    uint64_t version;
+    uint64_t slots;
+    uint64_t capacity;
+    uint64_t used;
+    uint64_t generation;
+};
+
+struct CASCache::Entry {
+    uint64_t key[2];
+    uint64_t offset;
+    uint64_t size;
+};
+
+static constexpr char magic[8] = { 'C', 'A', 'S', 'C', 'A', 'C', 'H', 'E' };
+static constexpr uint64_t version = 1;
+static constexpr uint64_t slots = 1 << 16;
+static constexpr int probes = 32;
+static constexpr uint64_t dataStart = 4096 + slots * 32;
+
+static uint64_t recordSize(const VSFrameRef * frame, const bool * planes, const VSAPI * vsapi) noexcept {
+    const VSFormat * format = vsapi->getFrameFormat(frame);
+    uint64_t size = 0;
+    for (int plane = 0; plane < format->numPlanes; plane++) {
+        if (planes[plane])
+            size += static_cast<uint64_t>(vsapi->getFrameWidth(frame, plane)) * format->bytesPerSample * vsapi->getFrameHeight(frame, plane);
+    }
+    return size;
+}
+
+// A record ends with the float properties the filter set on the frame, all named CAS..., each stored as its name's length, its name, its
+// number of values and the values.
+static std::vector<uint8_t> packProps(const VSFrameRef * frame, const VSAPI * vsapi) {
+    const VSMap * props = vsapi->getFramePropsRO(frame);
+    std::vector<uint8_t> packed;
+    for (int i = 0; i < vsapi->propNumKeys(props); i++) {
+        const char * key = vsapi->propGetKey(props, i);
+        const size_t length = std::strlen(key);
+        if (std::strncmp(key, "CAS", 3) || length > 255 || vsapi->propGetType(props, key) != ptFloat || vsapi->propNumElements(props, key) < 1)
+            continue;
+
+        int err;
+        const uint32_t count = vsapi->propNumElements(props, key);
+        const double * values = vsapi->propGetFloatArray(props, key, &err);
+        const size_t at = packed.size();
+        packed.resize(at + 1 + length + sizeof(count) + count * sizeof(double));
+        packed[at] = static_cast<uint8_t>(length);
+        std::memcpy(packed.data() + at + 1, key, length);
+        std::memcpy(packed.data() + at + 1 + length, &count, sizeof(count));
+        std::memcpy(packed.data() + at + 1 + length + sizeof(count), values, count * sizeof(double));
+    }
+    return packed;
+}
+
+static void unpackProps(const uint8_t * packed, const uint64_t size, VSFrameRef * frame, const VSAPI * vsapi) {
+    VSMap * props = vsapi->getFramePropsRW(frame);
+    uint64_t at = 0;
+    while (at < size) {
+        const size_t length = packed[at];
+        uint32_t count;
+        if (size - at < 1 + length + sizeof(count))
+            return;
+        std::memcpy(&count, packed + at + 1 + length, sizeof(count));
+        if (!count || (size - at - 1 - length - sizeof(count)) / sizeof(double) < count)
+            return;
+
+        const std::string key(reinterpret_cast<const char *>(packed + at + 1), length);
+        std::vector<double> values(count);
+        std::memcpy(values.data(), packed + at + 1 + length + sizeof(count), count * sizeof(double));
+        vsapi->propDeleteKey(props, key.c_str());
+        vsapi->propSetFloatArray(props, key.c_str(), values.data(), count);
+        at += 1 + length + sizeof(count) + count * sizeof(double);
+    }
+}
+
+CASCache::CASCache(const std::string & dir, const uint64_t capacity) {
+    static_assert(sizeof(Header) <= 4096 && sizeof(Entry) == 32, "unexpected cache layout");
+
+    const std::string path = dir + "/CAS.cache";
+    Header stored = {};
+    bool fresh;
+
+#ifdef _WIN32
+    std::wstring widePath(MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0), L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, widePath.data(), static_cast<int>(widePath.size()));
+
+    file = CreateFileW(widePath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS,
+                       FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw "cache_dir could not be opened";
+
+    lock(true);
+
+    LARGE_INTEGER size;
+    DWORD bytesRead = 0;
+    GetFileSizeEx(file, &size);
+    fresh = !size.QuadPart;
+    if (!fresh && (!ReadFile(file, &stored, sizeof(stored), &bytesRead, nullptr) || bytesRead != sizeof(stored)))
+        stored = {};
+#else
+    file = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (file == -1)
+        throw "cache_dir could not be opened";
+
+    lock(true);
+
+    struct stat status;
+    fstat(file, &status);
+    fileSize = status.st_size;
+    fresh = !fileSize;
+    if (!fresh && (fileSize < dataStart || pread(file, &stored, sizeof(stored), 0) != sizeof(stored)))
+        stored = {};
+#endif
+
+    // A file created by another process keeps the size limit it was created with.
+    if (!fresh && (std::memcmp(stored.magic, magic, sizeof(magic)) || stored.version != version || stored.slots != slots)) {
+        unlock();
+#ifdef _WIN32
+        CloseHandle(file);
+#else
+        close(file);
+#endif
+        throw "cache_dir contains an incompatible cache file";
+    }
+
+    viewSize = dataStart + (fresh ? capacity : stored.capacity);
+
+#ifdef _WIN32
+    // The mapping extends the file to its full size up front.
+    mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(viewSize >> 32), static_cast<DWORD>(viewSize), nullptr);
+    view = mapping ? static_cast<uint8_t *>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0)) : nullptr;
+    if (!view) {
+        if (mapping)
+            CloseHandle(mapping);
+        unlock();
+        CloseHandle(file);
+        throw "failed to map the cache file";
+    }
+#else
+    // The whole size limit is mapped once, while the file itself only grows as records are appended.
+    if (fresh && !ftruncate(file, dataStart))
+        fileSize = dataStart;
+
+    void * address = fileSize >= dataStart ? mmap(nullptr, viewSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0) : MAP_FAILED;
+    if (address == MAP_FAILED) {
+        unlock();
+        close(file);
+        throw "failed to map the cache file";
+    }
+    view = static_cast<uint8_t *>(address);
+#endif
+
+    header = reinterpret_cast<Header *>(view);
+    index = reinterpret_cast<Entry *>(view + 4096);
+    data = view + dataStart;
+
+    if (fresh) {
+        std::memcpy(header->magic, magic, sizeof(magic));
+        header->version = version;
+        header->slots = slots;
+        header->capacity = capacity;
+    }
+
+    unlock();
+}
+
+CASCache::~CASCache() {
+#ifdef _WIN32
+    UnmapViewOfFile(view);
+    CloseHandle(mapping);
+    CloseHandle(file);
+#else
+    munmap(view, viewSize);
+    close(file);
+#endif
+}
+
+void CASCache::lock(const bool exclusive) noexcept {
+#ifdef _WIN32
+    OVERLAPPED overlapped = {};
+    LockFileEx(file, exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, MAXDWORD, MAXDWORD, &overlapped);
+#else
+    while (flock(file, exclusive ? LOCK_EX : LOCK_SH) == -1 && errno == EINTR)
+        ;
+#endif
+}
+
+void CASCache::unlock() noexcept {
+#ifdef _WIN32
+    OVERLAPPED overlapped = {};
+    UnlockFileEx(file, 0, MAXDWORD, MAXDWORD, &overlapped);
+#else
+    flock(file, LOCK_UN);
+#endif
+}
+
+CASCache::Entry * CASCache::find(const std::array<uint64_t, 2> & key, const bool insert) noexcept {
+    for (int i = 0; i < probes; i++) {
+        Entry * entry = index + ((key[0] + i) & (slots - 1));
+        if (!entry->size)
+            return insert ? entry : nullptr;
+
+        if (entry->key[0] == key[0] && entry->key[1] == key[1])
+            return insert ? nullptr : entry;
+    }
+
+    return nullptr;
+}
+
+bool CASCache::read(const std::array<uint64_t, 2> & key, VSFrameRef * frame, const bool * planes, const VSAPI * vsapi) {
+    const uint64_t size = recordSize(frame, planes, vsapi);
+    const uint64_t capacity = viewSize - dataStart;
+    bool found = false;
+
+    // flock and LockFileEx locks belong to the file handle, which all threads of this instance share.
+    std::lock_guard<std::mutex> guard(mutex);
+    lock(false);
+
+    const Entry * entry = find(key, false);
+    if (entry && entry->size >= size && entry->size <= capacity && entry->offset <= capacity - entry->size) {
+        const VSFormat * format = vsapi->getFrameFormat(frame);
+        const uint8_t * srcp = data + entry->offset;
+
+        for (int plane = 0; plane < format->numPlanes; plane++) {
+            if (!planes[plane])
+                continue;
+
+            const int rowSize = vsapi->getFrameWidth(frame, plane) * format->bytesPerSample;
+            const int height = vsapi->getFrameHeight(frame, plane);
+            vs_bitblt(vsapi->getWritePtr(frame, plane), vsapi->getStride(frame, plane), srcp, rowSize, rowSize, height);
+            srcp += static_cast<uint64_t>(rowSize) * height;
+        }
+
+        unpackProps(srcp, entry->size - size, frame, vsapi);
+        found = true;
+    }
+
+    unlock();
+    return found;
+}
+
+void CASCache::write(const std::array<uint64_t, 2> & key, const VSFrameRef * frame, const bool * planes, const VSAPI * vsapi) {
+    const std::vector<uint8_t> props = packProps(frame, vsapi);
+    const uint64_t size = recordSize(frame, planes, vsapi) + props.size();
+    const uint64_t capacity = viewSize - dataStart;
+    if (!size || size > capacity)
+        return;
+
+    std::lock_guard<std::mutex> guard(mutex);
+    lock(true);
+
+    // Another process may have stored the same frame in the meantime.
+    if (find(key, false)) {
+        unlock();
+        return;
+    }
+
+    uint64_t offset = (header->used + 63) & ~static_cast<uint64_t>(63);
+    Entry * entry = offset <= capacity - size ? find(key, true) : nullptr;
+    if (!entry) {
+        std::memset(index, 0, slots * sizeof(Entry));
+        header->used = 0;
+        header->generation++;
+        offset = 0;
+        entry = find(key, true);
+    }
+
+#ifndef _WIN32
+    if (dataStart + offset + size > fileSize) {
+        struct stat status;
+        fstat(file, &status);
+        fileSize = status.st_size;
+
+        // Grow in steps of at least 64 MiB to keep the number of truncations down.
+        const uint64_t needed = dataStart + offset + size;
+        const uint64_t grown = std::min(viewSize, std::max(needed, fileSize + (static_cast<uint64_t>(64) << 20)));
+        if (needed > fileSize && ftruncate(file, grown)) {
+            unlock();
+            return;
+        }
+        fileSize = std::max(fileSize, grown);
+    }
+#endif
+
+    const VSFormat * format = vsapi->getFrameFormat(frame);
+    uint8_t * dstp = data + offset;
+
+    for (int plane = 0; plane < format->numPlanes; plane++) {
+        if (!planes[plane])
+            continue;
+
+        const int rowSize = vsapi->getFrameWidth(frame, plane) * format->bytesPerSample;
+        const int height = vsapi->getFrameHeight(frame, plane);
+        vs_bitblt(dstp, rowSize, vsapi->getReadPtr(frame, plane), vsapi->getStride(frame, plane), rowSize, height);
+        dstp += static_cast<uint64_t>(rowSize) * height;
+    }
+    if (!props.empty())
+        std::memcpy(dstp, props.data(), props.size());
+
+    // The entry is only published once its record is complete, so a writer that dies halfway leaves no trace in the index.
+    entry->key[0] = key[0];
+    entry->key[1] = key[1];
+    entry->offset = offset;
+    entry->size = size;
+    header->used = offset + size;
+
+    unlock();
+}
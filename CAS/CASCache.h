@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include <VapourSynth.h>
+
+// Output frames stored in a memory-mapped file shared by every process using the same directory. Records are appended after a fixed size index
+// and the whole cache starts over once either is full. Readers hold a shared file lock while copying out and writers an exclusive one.
+struct CASCache final {
+    CASCache(const std::string & dir, const uint64_t capacity);
+    ~CASCache();
+
+    bool read(const std::array<uint64_t, 2> & key, VSFrameRef * frame, const bool * planes, const VSAPI * vsapi);
+    void write(const std::array<uint64_t, 2> & key, const VSFrameRef * frame, const bool * planes, const VSAPI * vsapi);
+
+private:
+    struct Header;
+    struct Entry;
+
+    void lock(const bool exclusive) noexcept;
+    void unlock() noexcept;
+    Entry * find(const std::array<uint64_t, 2> & key, const bool insert) noexcept;
+
+#ifdef _WIN32
+    void * file;
+    void * mapping;
+#else
+    int file;
+    uint64_t fileSize;
+#endif
+    uint8_t * view;
+    uint64_t viewSize;
+    Header * header;
+    Entry * index;
+    uint8_t * data;
+    std::mutex mutex;
+};
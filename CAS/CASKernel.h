@@ -0,0 +1,120 @@
+#pragma once
+
+#include <any>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "libcas.h"
+
+#ifdef CAS_X86
+#include "VCL2/vectorclass.h"
+#endif
+
+#ifndef VS_RESTRICT
+#ifdef _MSC_VER
+#define VS_RESTRICT __restrict
+#else
+#define VS_RESTRICT __restrict__
+#endif
+#endif
+
+struct CASResize final {
+    std::vector<int> index;
+    std::vector<float> frac;
+};
+
+// Contrast statistics of a plane: the sum of the adaptive amplitudes, their histogram in eight equal bins over [0, 1], and the number of
+// sharpened samples outside the sample range before clamping.
+struct CASStats final {
+    double ampSum;
+    int64_t histogram[8];
+    int64_t clipped;
+    int64_t count;
+};
+
+// Planes handed to the kernels. Strides are in samples, and the destination has the upscaled dimensions when upscaling.
+// Destination rows are aligned and padded to 64 bytes, so the kernels may write whole vectors past the right edge. So are source rows,
+// except for the plain kernel, which copies exactly the row's samples and may be given a cropped source starting anywhere.
+struct CASPlanes final {
+    const void * srcp[3];
+    void * dstp[3];
+    ptrdiff_t srcStride[3];
+    ptrdiff_t dstStride[3];
+    int width[3];
+    int height[3];
+    int dstWidth[3];
+    int dstHeight[3];
+    // Accumulates the statistics of the guide plane (G for RGB, Y otherwise) when not null.
+    CASStats * stats;
+};
+
+// Everything the kernels need to know about the format and the parameters, filled in by casConfigure.
+struct CASKernel {
+    int numPlanes;
+    int subSamplingW;
+    int subSamplingH;
+    int bytesPerSample;
+    int width[3], height[3];
+    size_t rowSize;
+    bool padded;
+    bool rgb;
+    float sharpness;
+    bool process[3];
+    bool sharedAmp;
+    int ampScale;
+    bool fields;
+    CASResize columns[3], rows[3];
+    std::any limit;
+    int peak;
+    bool linear[3];
+    float black;
+    // Range of float samples, other than centred chroma, outside of which a sharpened sample counts as clipped in the statistics.
+    float clipLow, clipHigh;
+    std::vector<float> toLinear, fromLinear;
+    std::unique_ptr<CASKernel> linearKernel;
+    // Instruction set of the kernels: 0 = C, 1 = SSE2, 2 = AVX2, 3 = AVX-512. Float results differ slightly between them.
+    int isa;
+    void (*filter)(const CASPlanes & planes, const CASKernel * const VS_RESTRICT data) noexcept;
+    void (*filterRow)(const void * above, const void * srcp, const void * below, void * dstp, const int width, const int plane,
+                      const CASKernel * const VS_RESTRICT data) noexcept;
+    // filterRow that also accumulates statistics, and only measures the row when dstp is null.
+    void (*analyzeRow)(const void * above, const void * srcp, const void * below, void * dstp, const int width, const int plane,
+                       const CASKernel * const VS_RESTRICT data, CASStats * stats) noexcept;
+};
+
+void casConfigure(CASKernel * d, const CASConfig & config);
+
+// Runs the kernel on the planes, once per field with fields.
+void casFilter(const CASPlanes & planes, const CASKernel * d) noexcept;
+
+// Measures the statistics of the guide plane without sharpening it.
+void casAnalyze(const CASPlanes & planes, const CASKernel * d, CASStats * stats) noexcept;
+
+// Scratch memory of the calling thread, 64 byte aligned, taken from an arena shared by every kernel and instance. Scratch must be released
+// in the reverse order it was taken, which holding it in a local variable ensures.
+struct CASScratch final {
+    explicit CASScratch(size_t size) noexcept;
+    ~CASScratch();
+    CASScratch(const CASScratch &) = delete;
+    CASScratch & operator=(const CASScratch &) = delete;
+
+    template<typename T>
+    T * get() const noexcept {
+        return static_cast<T *>(pointer);
+    }
+
+    void * pointer;
+    size_t offset;
+    size_t size;
+};
+
+// Raises the size the arenas start at to the scratch of the largest configured kernel, and backs them with transparent huge pages on Linux
+// once any configuration asks for it.
+void casReserveScratch(size_t size, bool hugePages) noexcept;
+
+// Largest amount of scratch in bytes that a thread has held at once.
+size_t casScratchPeak() noexcept;
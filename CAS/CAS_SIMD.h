@@ -0,0 +1,842 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "CASKernel.h"
+
+// The SIMD kernels, written once for any vector width. Each of CAS_SSE2.cpp, CAS_AVX2.cpp and CAS_AVX512.cpp compiles them for its
+// instruction set with a traits struct, which gives
+//  Vi, Vf, Vb: the vectors of int, float and int mask of the instruction set;
+//  load: the samples of a vector of uint8_t or uint16_t, widened to int;
+//  bytes, words: a vector of float rounded and narrowed to uint8_t and to uint16_t, the latter clamped to the peak;
+//  store: a vector of bytes or words, as many samples as there are lanes;
+//  window: the lanes of two vectors of float picked by index, for upscaling.
+
+// Lane permutes and blends, for a vector of size lanes. The first lane's left neighbour and the last lane's right neighbour are mirrored.
+enum Shuffle { LeftNeighbour, RightNeighbour, Even, Odd, LowPairs, HighPairs };
+
+static constexpr int shuffleIndex(const Shuffle shuffle, const int k, const int size) noexcept {
+    switch (shuffle) {
+    case LeftNeighbour:
+        return k == 0 ? 1 : k - 1;
+    case RightNeighbour:
+        return k == size - 1 ? size - 2 : k + 1;
+    case Even:
+        return k * 2;
+    case Odd:
+        return k * 2 + 1;
+    case LowPairs:
+        return k / 2;
+    default:
+        return size / 2 + k / 2;
+    }
+}
+
+template<Shuffle shuffle, typename vec_t, int... k>
+static inline vec_t permute(const vec_t a, std::integer_sequence<int, k...>) noexcept {
+    if constexpr (vec_t::size() == 4)
+        return permute4<shuffleIndex(shuffle, k, 4)...>(a);
+    else if constexpr (vec_t::size() == 8)
+        return permute8<shuffleIndex(shuffle, k, 8)...>(a);
+    else
+        return permute16<shuffleIndex(shuffle, k, 16)...>(a);
+}
+
+template<Shuffle shuffle, typename vec_t>
+static inline vec_t permute(const vec_t a) noexcept {
+    return permute<shuffle>(a, std::make_integer_sequence<int, vec_t::size()>());
+}
+
+template<Shuffle shuffle, typename vec_t, int... k>
+static inline vec_t blend(const vec_t a, const vec_t b, std::integer_sequence<int, k...>) noexcept {
+    if constexpr (vec_t::size() == 4)
+        return blend4<shuffleIndex(shuffle, k, 4)...>(a, b);
+    else if constexpr (vec_t::size() == 8)
+        return blend8<shuffleIndex(shuffle, k, 8)...>(a, b);
+    else
+        return blend16<shuffleIndex(shuffle, k, 16)...>(a, b);
+}
+
+template<Shuffle shuffle, typename vec_t>
+static inline vec_t blend(const vec_t a, const vec_t b) noexcept {
+    return blend<shuffle>(a, b, std::make_integer_sequence<int, vec_t::size()>());
+}
+
+template<typename isa, typename pixel_t>
+static inline auto load(const pixel_t * srcp) noexcept {
+    if constexpr (std::is_integral_v<pixel_t>)
+        return isa::load(srcp);
+    else
+        return typename isa::Vf().load(srcp);
+}
+
+template<typename isa, typename pixel_t>
+static inline void store(const typename isa::Vf srcp, pixel_t * dstp, const int peak) noexcept {
+    if constexpr (std::is_same_v<pixel_t, uint8_t>)
+        isa::store(isa::bytes(srcp), dstp);
+    else if constexpr (std::is_same_v<pixel_t, uint16_t>)
+        isa::store(isa::words(srcp, peak), dstp);
+    else
+        srcp.store_nt(dstp);
+}
+
+// Stores the first count samples of the last vector of a row, which would otherwise run past its right edge.
+template<typename isa, typename pixel_t>
+static void storePartial(const typename isa::Vf srcp, pixel_t * dstp, const int peak, const int count) noexcept {
+    if constexpr (std::is_same_v<pixel_t, uint8_t>)
+        isa::bytes(srcp).store_partial(count, dstp);
+    else if constexpr (std::is_same_v<pixel_t, uint16_t>)
+        isa::words(srcp, peak).store_partial(count, dstp);
+    else
+        srcp.store_partial(count, dstp);
+}
+
+template<typename isa, typename pixel_t>
+static inline void store(const typename isa::Vf srcp, pixel_t * dstp, const int peak, const int count) noexcept {
+    if (count >= srcp.size())
+        store<isa>(srcp, dstp, peak);
+    else
+        storePartial<isa>(srcp, dstp, peak, count);
+}
+
+alignas(64) static constexpr int32_t lanes[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+// The lane of the last column in the last vector of a row.
+template<typename isa>
+static inline typename isa::Vb lastLane(const int width, const int regularPart) noexcept {
+    return typename isa::Vi().load(lanes) == width - 1 - regularPart;
+}
+
+// Calls kernel with std::true_type for the planes whose amplitude adds the chroma offset, float planes other than the first, and with
+// std::false_type for the rest, so that each kind of plane gets a kernel of its own and luma never adds a zero offset.
+template<typename pixel_t, typename F>
+static inline void byPlaneKind(const int plane, F kernel) noexcept {
+    if constexpr (std::is_floating_point_v<pixel_t>) {
+        if (plane) {
+            kernel(std::true_type());
+            return;
+        }
+    }
+    kernel(std::false_type());
+}
+
+template<typename vec_t>
+static inline void softMinMax(const vec_t a, const vec_t b, const vec_t c, const vec_t d, const vec_t e, const vec_t f, const vec_t g, const vec_t h, const vec_t i,
+                              vec_t & mn, vec_t & mx) noexcept {
+    // Soft min and max.
+    //  a b c             b
+    //  d e f * 0.5  +  d e f * 0.5
+    //  g h i             h
+    // These are 2.0x bigger (factored out the extra multiply).
+    mn = min(min(min(d, e), min(f, b)), h);
+    const vec_t mn2 = min(min(min(mn, a), min(c, g)), i);
+    mn += mn2;
+
+    mx = max(max(max(d, e), max(f, b)), h);
+    const vec_t mx2 = max(max(max(mx, a), max(c, g)), i);
+    mx += mx2;
+}
+
+template<typename isa, bool chroma, typename vec_t>
+static inline typename isa::Vf amplitude(vec_t mn, vec_t mx, const vec_t limit, const float chromaOffset) noexcept {
+    using Vf = typename isa::Vf;
+
+    if constexpr (chroma) {
+        mn += chromaOffset;
+        mx += chromaOffset;
+    }
+
+    // Smooth minimum distance to signal limit divided by smooth max.
+    Vf amp;
+    if constexpr (std::is_same_v<vec_t, typename isa::Vi>)
+        amp = min(max(to_float(min(mn, limit - mx)) / to_float(mx), 0.0f), 1.0f);
+    else
+        amp = min(max(min(mn, limit - mx) / mx, 0.0f), 1.0f);
+
+    // Shaping amount of sharpening.
+    return sqrt(amp);
+}
+
+template<typename isa, bool chroma, typename vec_t>
+static inline typename isa::Vf amplitude(const vec_t a, const vec_t b, const vec_t c, const vec_t d, const vec_t e, const vec_t f, const vec_t g, const vec_t h,
+                                         const vec_t i, const vec_t limit, const float chromaOffset) noexcept {
+    vec_t mn, mx;
+    softMinMax(a, b, c, d, e, f, g, h, i, mn, mx);
+    return amplitude<isa, chroma>(mn, mx, limit, chromaOffset);
+}
+
+// The rows are bordered: each holds its samples mirrored past its first and last column, so that every vector takes its neighbours straight
+// from the row.
+template<typename isa, typename pixel_t, bool chroma, bool statistics = false, bool output = true>
+static inline void filterRow(const pixel_t * above, const pixel_t * srcp, const pixel_t * below, pixel_t * dstp, const int width,
+                             const CASKernel * const VS_RESTRICT data, CASStats * stats = nullptr) noexcept {
+    using var_t = std::conditional_t<std::is_integral_v<pixel_t>, int, float>;
+    using vec_t = std::conditional_t<std::is_integral_v<pixel_t>, typename isa::Vi, typename isa::Vf>;
+    using Vf = typename isa::Vf;
+
+    const vec_t limit = std::any_cast<var_t>(data->limit);
+
+    auto filtering = [&](const vec_t b, const vec_t d, const vec_t e, const vec_t f, const vec_t h, const vec_t mn, const vec_t mx, Vf & amp) noexcept {
+        // Filter shape.
+        //  0 w 0
+        //  w 1 w
+        //  0 w 0
+        amp = amplitude<isa, chroma>(mn, mx, limit, 1.0f);
+        const Vf weight = amp * data->sharpness;
+        if constexpr (std::is_integral_v<pixel_t>)
+            return mul_add(to_float((b + d) + (f + h)), weight, to_float(e)) / mul_add(4.0f, weight, 1.0f);
+        else
+            return mul_add((b + d) + (f + h), weight, e) / mul_add(4.0f, weight, 1.0f);
+    };
+
+    // Statistics are accumulated per lane over the row and added up at its end. The histogram counts the samples at or above the lower
+    // bound of each bin but the first, which needs no gathers.
+    const bool centred = chroma && !data->rgb;
+    const float low = std::is_integral_v<pixel_t> ? -0.5f : (centred ? -0.5f : data->clipLow);
+    const float high = std::is_integral_v<pixel_t> ? data->peak + 0.5f : (centred ? 0.5f : data->clipHigh);
+    Vf ampSum = 0.0f, clippedSum = 0.0f;
+    Vf atLeast[7];
+    for (int bin = 0; bin < 7; bin++)
+        atLeast[bin] = 0.0f;
+
+    auto account = [&](Vf amp, const Vf result, const int x) noexcept {
+        Vf clipped = select((result < low) | (result > high), Vf(1.0f), Vf(0.0f));
+        if (x + vec_t().size() > width) {
+            amp.cutoff(width - x);
+            clipped.cutoff(width - x);
+        }
+        ampSum += amp;
+        clippedSum += clipped;
+        for (int bin = 0; bin < 7; bin++)
+            atLeast[bin] = if_add(amp >= (bin + 1) / 8.0f, atLeast[bin], 1.0f);
+    };
+
+    auto finish = [&](const Vf result, const Vf amp, const int x) noexcept {
+        if constexpr (statistics)
+            account(amp, result, x);
+        if constexpr (output)
+            store<isa>(result, dstp + x, data->peak, width - x);
+    };
+
+    const int regularPart = (width - 1) & ~(vec_t().size() - 1);
+
+    for (int x = 0; x <= regularPart; x += vec_t().size()) {
+        const vec_t a = load<isa>(above + x - 1), b = load<isa>(above + x), c = load<isa>(above + x + 1);
+        const vec_t d = load<isa>(srcp + x - 1), e = load<isa>(srcp + x), f = load<isa>(srcp + x + 1);
+        const vec_t g = load<isa>(below + x - 1), h = load<isa>(below + x), i = load<isa>(below + x + 1);
+
+        // The soft minimum and maximum of softMinMax, whose second halves are the window's minimum and maximum. A window of integer samples
+        // that are all equal sharpens to its centre once rounded, so vectors made only of such windows skip straight to the store. Float
+        // samples are not rounded and the full path may land an ulp away from the centre, so they always take it.
+        const vec_t mnCross = min(min(min(d, e), min(f, b)), h);
+        const vec_t mn = min(min(min(mnCross, a), min(c, g)), i);
+        const vec_t mxCross = max(max(max(d, e), max(f, b)), h);
+        const vec_t mx = max(max(max(mxCross, a), max(c, g)), i);
+        if constexpr (std::is_integral_v<pixel_t>) {
+            if (horizontal_and(mn == mx)) {
+                Vf amp = 0.0f;
+                if constexpr (statistics)
+                    amp = amplitude<isa, chroma>(mnCross + mn, mxCross + mx, limit, 1.0f);
+                finish(to_float(e), amp, x);
+                continue;
+            }
+        }
+
+        Vf amp;
+        const Vf result = filtering(b, d, e, f, h, mnCross + mn, mxCross + mx, amp);
+
+        finish(result, amp, x);
+    }
+
+    if constexpr (statistics) {
+        stats->ampSum += horizontal_add(ampSum);
+        stats->clipped += static_cast<int64_t>(horizontal_add(clippedSum));
+        stats->count += width;
+
+        int64_t previous = width;
+        for (int bin = 0; bin < 7; bin++) {
+            const int64_t count = static_cast<int64_t>(horizontal_add(atLeast[bin]));
+            stats->histogram[bin] += previous - count;
+            previous = count;
+        }
+        stats->histogram[7] += previous;
+    }
+}
+
+// Mirrors the samples of a row past its first and last column. The rest of the last vector, of at most 16 samples, repeats the mirrored
+// sample, so that its lanes past the last column are flat exactly when the last column's window is and never stop the flat skip.
+template<typename pixel_t>
+static inline void border(pixel_t * row, const int width) noexcept {
+    row[-1] = row[1];
+    row[width] = row[width - 2];
+    std::fill_n(row + width + 1, 15, row[width]);
+}
+
+// Each source row is copied once to a ring of four rows, with its samples mirrored past the first and last column, a row before it is
+// first read so that the copy has left the store buffer. Only the row's own samples are copied, as a cropped row starts anywhere in the
+// source and may end at the end of its allocation; whole lines are still copied while they fit, which a single call does not match.
+template<typename isa, typename pixel_t, bool chroma, bool statistics>
+static void filterPlane(const CASPlanes & planes, const int plane, pixel_t * ring, const int ringStride, const CASKernel * const VS_RESTRICT data) noexcept {
+    const int width = planes.width[plane];
+    const int height = planes.height[plane];
+    const ptrdiff_t stride = planes.srcStride[plane];
+    const ptrdiff_t dstStride = planes.dstStride[plane];
+    const pixel_t * srcp = static_cast<const pixel_t *>(planes.srcp[plane]);
+    pixel_t * dstp = static_cast<pixel_t *>(planes.dstp[plane]);
+
+    auto copy = [&](const int y) noexcept {
+        pixel_t * row = ring + ringStride * (y & 3);
+        const pixel_t * src = srcp + y * stride;
+        int x = 0;
+        for (; x <= width - 64 / static_cast<int>(sizeof(pixel_t)); x += 64 / sizeof(pixel_t))
+            std::memcpy(row + x, src + x, 64);
+        std::memcpy(row + x, src + x, (width - x) * sizeof(pixel_t));
+        border(row, width);
+    };
+
+    for (int y = 0; y < std::min(height, 3); y++)
+        copy(y);
+
+    for (int y = 0; y < height; y++) {
+        const pixel_t * row = ring + ringStride * (y & 3);
+        const pixel_t * above = ring + ringStride * ((y == 0 ? 1 : y - 1) & 3);
+        const pixel_t * below = ring + ringStride * ((y == height - 1 ? y - 1 : y + 1) & 3);
+
+        filterRow<isa, pixel_t, chroma, statistics>(above, row, below, dstp, width, data, planes.stats);
+
+        if (y + 3 < height)
+            copy(y + 3);
+
+        dstp += dstStride;
+    }
+}
+
+// Amplitude is computed once per pixel from the guide plane (G for RGB, Y otherwise) and shared by every processed plane. Subsampled
+// chroma takes the amplitude of the co-sited luma sample.
+template<typename isa, typename pixel_t, bool chroma>
+static void filterShared(const CASPlanes & planes, const CASKernel * const VS_RESTRICT data) noexcept {
+    using var_t = std::conditional_t<std::is_integral_v<pixel_t>, int, float>;
+    using vec_t = std::conditional_t<std::is_integral_v<pixel_t>, typename isa::Vi, typename isa::Vf>;
+    using Vf = typename isa::Vf;
+    using Vb = typename isa::Vb;
+
+    const int guide = data->rgb ? 1 : 0;
+    const int ssw = data->subSamplingW;
+    const int ssh = data->subSamplingH;
+
+    const int width = planes.width[guide];
+    const int height = planes.height[guide];
+    const ptrdiff_t guideStride = planes.srcStride[guide];
+    const pixel_t * guidep = static_cast<const pixel_t *>(planes.srcp[guide]);
+
+    const vec_t limit = std::any_cast<var_t>(data->limit);
+
+    const int regularPart = (width - 1) & ~(vec_t().size() - 1);
+    const Vb lastColumn = lastLane<isa>(width, regularPart);
+    const int paddedWidth = regularPart + vec_t().size();
+
+    CASScratch buffer{ paddedWidth * 4 * sizeof(float) };
+    float * weightp = buffer.get<float>();
+    float * rcpp = weightp + paddedWidth;
+    float * chromaWeightp = rcpp + paddedWidth;
+    float * chromaRcpp = chromaWeightp + paddedWidth;
+
+    auto sharpen = [&](const vec_t b, const vec_t d, const vec_t e, const vec_t f, const vec_t h, const float * weightp, const float * rcpp) noexcept {
+        const Vf weight = Vf().load(weightp);
+        const Vf rcp = Vf().load(rcpp);
+        if constexpr (std::is_integral_v<pixel_t>)
+            return mul_add(to_float((b + d) + (f + h)), weight, to_float(e)) * rcp;
+        else
+            return mul_add((b + d) + (f + h), weight, e) * rcp;
+    };
+
+    auto sharpenRow = [&](const int plane, const int y, const float * weightp, const float * rcpp) noexcept {
+        const int width = planes.width[plane];
+        const int height = planes.height[plane];
+        const ptrdiff_t stride = planes.srcStride[plane];
+        const ptrdiff_t dstStride = planes.dstStride[plane];
+        const pixel_t * srcp = static_cast<const pixel_t *>(planes.srcp[plane]) + y * stride;
+        pixel_t * dstp = static_cast<pixel_t *>(planes.dstp[plane]) + y * dstStride;
+
+        const pixel_t * above = srcp + (y == 0 ? stride : -stride);
+        const pixel_t * below = srcp + (y == height - 1 ? -stride : stride);
+
+        const int regularPart = (width - 1) & ~(vec_t().size() - 1);
+        const Vb lastColumn = lastLane<isa>(width, regularPart);
+
+        {
+            const vec_t e = load<isa>(srcp + 0);
+            const vec_t d = permute<LeftNeighbour>(e);
+
+            vec_t f;
+            if (width > vec_t().size())
+                f = load<isa>(srcp + 1);
+            else
+                f = select(lastColumn, d, permute<RightNeighbour>(e));
+
+            store<isa>(sharpen(load<isa>(above + 0), d, e, f, load<isa>(below + 0), weightp + 0, rcpp + 0), dstp + 0, data->peak);
+        }
+
+        for (int x = vec_t().size(); x < regularPart; x += vec_t().size())
+            store<isa>(sharpen(load<isa>(above + x), load<isa>(srcp + x - 1), load<isa>(srcp + x), load<isa>(srcp + x + 1), load<isa>(below + x),
+                               weightp + x, rcpp + x),
+                       dstp + x, data->peak);
+
+        if (regularPart >= vec_t().size()) {
+            const vec_t d = load<isa>(srcp + regularPart - 1);
+            const vec_t e = load<isa>(srcp + regularPart);
+            const vec_t f = select(lastColumn, d, permute<RightNeighbour>(e));
+
+            store<isa>(sharpen(load<isa>(above + regularPart), d, e, f, load<isa>(below + regularPart), weightp + regularPart, rcpp + regularPart),
+                       dstp + regularPart, data->peak);
+        }
+    };
+
+    auto storeWeight = [&](const Vf amp, const int x) noexcept {
+        const Vf weight = amp * data->sharpness;
+        weight.store(weightp + x);
+        (1.0f / mul_add(4.0f, weight, 1.0f)).store(rcpp + x);
+    };
+
+    for (int y = 0; y < height; y++) {
+        const pixel_t * above = guidep + (y == 0 ? guideStride : -guideStride);
+        const pixel_t * below = guidep + (y == height - 1 ? -guideStride : guideStride);
+
+        {
+            const vec_t b = load<isa>(above + 0);
+            const vec_t e = load<isa>(guidep + 0);
+            const vec_t h = load<isa>(below + 0);
+
+            const vec_t a = permute<LeftNeighbour>(b);
+            const vec_t d = permute<LeftNeighbour>(e);
+            const vec_t g = permute<LeftNeighbour>(h);
+
+            vec_t c, f, i;
+            if (width > vec_t().size()) {
+                c = load<isa>(above + 1);
+                f = load<isa>(guidep + 1);
+                i = load<isa>(below + 1);
+            } else {
+                c = select(lastColumn, a, permute<RightNeighbour>(b));
+                f = select(lastColumn, d, permute<RightNeighbour>(e));
+                i = select(lastColumn, g, permute<RightNeighbour>(h));
+            }
+
+            storeWeight(amplitude<isa, chroma>(a, b, c,
+                                               d, e, f,
+                                               g, h, i,
+                                               limit, 1.0f), 0);
+        }
+
+        for (int x = vec_t().size(); x < regularPart; x += vec_t().size())
+            storeWeight(amplitude<isa, chroma>(load<isa>(above + x - 1), load<isa>(above + x), load<isa>(above + x + 1),
+                                               load<isa>(guidep + x - 1), load<isa>(guidep + x), load<isa>(guidep + x + 1),
+                                               load<isa>(below + x - 1), load<isa>(below + x), load<isa>(below + x + 1),
+                                               limit, 1.0f), x);
+
+        if (regularPart >= vec_t().size()) {
+            const vec_t a = load<isa>(above + regularPart - 1);
+            const vec_t d = load<isa>(guidep + regularPart - 1);
+            const vec_t g = load<isa>(below + regularPart - 1);
+
+            const vec_t b = load<isa>(above + regularPart);
+            const vec_t e = load<isa>(guidep + regularPart);
+            const vec_t h = load<isa>(below + regularPart);
+
+            const vec_t c = select(lastColumn, a, permute<RightNeighbour>(b));
+            const vec_t f = select(lastColumn, d, permute<RightNeighbour>(e));
+            const vec_t i = select(lastColumn, g, permute<RightNeighbour>(h));
+
+            storeWeight(amplitude<isa, chroma>(a, b, c,
+                                               d, e, f,
+                                               g, h, i,
+                                               limit, 1.0f), regularPart);
+        }
+
+        const bool chromaRow = !(y & ((1 << ssh) - 1));
+        if (chromaRow && (ssw || ssh) && (data->process[1] || data->process[2])) {
+            for (int x = 0; x < width >> ssw; x++) {
+                chromaWeightp[x] = weightp[x << ssw];
+                chromaRcpp[x] = rcpp[x << ssw];
+            }
+        }
+
+        for (int plane = 0; plane < data->numPlanes; plane++) {
+            if (data->process[plane]) {
+                if (plane == 0 || !(ssw || ssh))
+                    sharpenRow(plane, y, weightp, rcpp);
+                else if (chromaRow)
+                    sharpenRow(plane, y >> ssh, chromaWeightp, chromaRcpp);
+            }
+        }
+
+        guidep += guideStride;
+    }
+}
+
+// Amplitude is computed once per 2x2 block from the mean soft minimum and maximum of its samples, and shared by all four. Summing the four
+// samples' values instead of averaging them only scales the limit and the chroma offset.
+template<typename isa, typename pixel_t, bool chroma>
+static void filterBlocks(const CASPlanes & planes, const int plane, const CASKernel * const VS_RESTRICT data) noexcept {
+    using var_t = std::conditional_t<std::is_integral_v<pixel_t>, int, float>;
+    using vec_t = std::conditional_t<std::is_integral_v<pixel_t>, typename isa::Vi, typename isa::Vf>;
+    using Vf = typename isa::Vf;
+    using Vb = typename isa::Vb;
+
+    const vec_t limit = std::any_cast<var_t>(data->limit) * 4;
+
+    const int width = planes.width[plane];
+    const int height = planes.height[plane];
+    const ptrdiff_t stride = planes.srcStride[plane];
+    const ptrdiff_t dstStride = planes.dstStride[plane];
+    const pixel_t * srcp = static_cast<const pixel_t *>(planes.srcp[plane]);
+    pixel_t * dstp = static_cast<pixel_t *>(planes.dstp[plane]);
+
+    const int regularPart = (width - 1) & ~(vec_t().size() - 1);
+    const Vb lastColumn = lastLane<isa>(width, regularPart);
+
+    // Left neighbour, sample and right neighbour of a vector, mirrored at the edges like filterRow.
+    struct Columns {
+        vec_t left, centre, right;
+    };
+
+    auto columns = [&](const pixel_t * row, const int x) noexcept {
+        Columns col;
+        col.centre = load<isa>(row + x);
+        col.left = x == 0 ? permute<LeftNeighbour>(col.centre) : load<isa>(row + x - 1);
+        col.right = x >= regularPart ? select(lastColumn, col.left, permute<RightNeighbour>(col.centre)) : load<isa>(row + x + 1);
+        return col;
+    };
+
+    auto soft = [](const Columns & above, const Columns & row, const Columns & below, vec_t & mn, vec_t & mx) noexcept {
+        softMinMax(above.left, above.centre, above.right,
+                   row.left, row.centre, row.right,
+                   below.left, below.centre, below.right,
+                   mn, mx);
+    };
+
+    auto sharpen = [&](const Columns & above, const Columns & row, const Columns & below, const Vf weight, const Vf rcp, pixel_t * dstp) noexcept {
+        Vf result;
+        if constexpr (std::is_integral_v<pixel_t>)
+            result = mul_add(to_float((above.centre + row.left) + (row.right + below.centre)), weight, to_float(row.centre)) * rcp;
+        else
+            result = mul_add((above.centre + row.left) + (row.right + below.centre), weight, row.centre) * rcp;
+        store<isa>(result, dstp, data->peak);
+    };
+
+    auto copy = [&](const Columns & row, pixel_t * dstp) noexcept {
+        if constexpr (std::is_integral_v<pixel_t>)
+            store<isa>(to_float(row.centre), dstp, data->peak);
+        else
+            store<isa>(row.centre, dstp, data->peak);
+    };
+
+    for (int y = 0; y < height; y += 2) {
+        // An odd plane's last row forms a block with itself.
+        const int y1 = std::min(y + 1, height - 1);
+        const pixel_t * row0 = srcp + y * stride;
+        const pixel_t * above = row0 + (y == 0 ? stride : -stride);
+        const pixel_t * row1 = y1 != y ? row0 + stride : above;
+        const pixel_t * below = row1 + (y1 == height - 1 ? -stride : stride);
+
+        // Each pair of vectors of samples gives one vector of blocks, whose weights are spread back over both.
+        for (int x = 0; x <= regularPart; x += vec_t().size() * 2) {
+            const int x2 = std::min(x + vec_t().size(), regularPart);
+
+            const Columns a0 = columns(above, x), a1 = columns(above, x2);
+            const Columns r0 = columns(row0, x), r1 = columns(row0, x2);
+            const Columns s0 = columns(row1, x), s1 = columns(row1, x2);
+
+            vec_t mnLow, mxLow, mnHigh, mxHigh, mn, mx;
+            soft(a0, r0, s0, mnLow, mxLow);
+            soft(a1, r1, s1, mnHigh, mxHigh);
+            if (y1 != y) {
+                const Columns b0 = columns(below, x), b1 = columns(below, x2);
+                soft(r0, s0, b0, mn, mx);
+                mnLow += mn;
+                mxLow += mx;
+                soft(r1, s1, b1, mn, mx);
+                mnHigh += mn;
+                mxHigh += mx;
+            } else {
+                mnLow += mnLow;
+                mxLow += mxLow;
+                mnHigh += mnHigh;
+                mxHigh += mxHigh;
+            }
+
+            // The soft minimum and maximum only sum to the same value where both rows' samples are flat. Float samples are not rounded, and
+            // sharpening a flat block may move them by an ulp, so they always take the full path.
+            if (std::is_integral_v<pixel_t> && horizontal_and((mnLow == mxLow) & (mnHigh == mxHigh))) {
+                copy(r0, dstp + y * dstStride + x);
+                if (x2 != x)
+                    copy(r1, dstp + y * dstStride + x2);
+                if (y1 != y) {
+                    copy(s0, dstp + y1 * dstStride + x);
+                    if (x2 != x)
+                        copy(s1, dstp + y1 * dstStride + x2);
+                }
+                continue;
+            }
+
+            // An odd plane's last column also forms a block with itself.
+            if (width & 1) {
+                const int last = (width - 1) & (vec_t().size() * 2 - 1);
+                if (x + vec_t().size() * 2 > width - 1) {
+                    if (last < vec_t().size()) {
+                        mnLow.insert(last + 1, mnLow[last]);
+                        mxLow.insert(last + 1, mxLow[last]);
+                    } else {
+                        mnHigh.insert(last - vec_t().size() + 1, mnHigh[last - vec_t().size()]);
+                        mxHigh.insert(last - vec_t().size() + 1, mxHigh[last - vec_t().size()]);
+                    }
+                }
+            }
+
+            mn = blend<Even>(mnLow, mnHigh) + blend<Odd>(mnLow, mnHigh);
+            mx = blend<Even>(mxLow, mxHigh) + blend<Odd>(mxLow, mxHigh);
+
+            const Vf weight = amplitude<isa, chroma>(mn, mx, limit, 4.0f) * data->sharpness;
+            const Vf rcp = 1.0f / mul_add(4.0f, weight, 1.0f);
+            const Vf weightLow = permute<LowPairs>(weight), weightHigh = permute<HighPairs>(weight);
+            const Vf rcpLow = permute<LowPairs>(rcp), rcpHigh = permute<HighPairs>(rcp);
+
+            sharpen(a0, r0, s0, weightLow, rcpLow, dstp + y * dstStride + x);
+            if (x2 != x)
+                sharpen(a1, r1, s1, weightHigh, rcpHigh, dstp + y * dstStride + x2);
+
+            if (y1 != y) {
+                const Columns b0 = columns(below, x), b1 = columns(below, x2);
+                sharpen(r0, s0, b0, weightLow, rcpLow, dstp + y1 * dstStride + x);
+                if (x2 != x)
+                    sharpen(r1, s1, b1, weightHigh, rcpHigh, dstp + y1 * dstStride + x2);
+            }
+        }
+    }
+}
+
+template<typename isa, typename pixel_t>
+void filter_simd(const CASPlanes & planes, const CASKernel * const VS_RESTRICT data) noexcept {
+    if (data->sharedAmp) {
+        byPlaneKind<pixel_t>(data->rgb ? 1 : 0, [&](auto chroma) noexcept { filterShared<isa, pixel_t, decltype(chroma)::value>(planes, data); });
+        return;
+    }
+
+    if (data->ampScale == 2) {
+        for (int plane = 0; plane < data->numPlanes; plane++) {
+            if (data->process[plane])
+                byPlaneKind<pixel_t>(plane, [&](auto chroma) noexcept { filterBlocks<isa, pixel_t, decltype(chroma)::value>(planes, plane, data); });
+        }
+        return;
+    }
+
+    // Rows of the ring are copied in whole 64 byte lines, and start a line into their slot. The first plane is the widest.
+    const int line = 64 / sizeof(pixel_t);
+    const int ringStride = ((planes.width[0] + line - 1) / line + 2) * line;
+    CASScratch buffer{ (ringStride * 4 + line) * sizeof(pixel_t) };
+    pixel_t * ring = buffer.get<pixel_t>() + line;
+
+    for (int plane = 0; plane < data->numPlanes; plane++) {
+        if (data->process[plane]) {
+            const bool statistics = planes.stats && plane == (data->rgb ? 1 : 0);
+            byPlaneKind<pixel_t>(plane, [&](auto chroma) noexcept {
+                if (statistics)
+                    filterPlane<isa, pixel_t, decltype(chroma)::value, true>(planes, plane, ring, ringStride, data);
+                else
+                    filterPlane<isa, pixel_t, decltype(chroma)::value, false>(planes, plane, ring, ringStride, data);
+            });
+        }
+    }
+}
+
+// The row kernels copy their three rows to bordered rows of scratch. Each row starts a 64 byte line into its slot, and has a line past its
+// end for the vector reaching past its last column.
+template<typename pixel_t>
+static int borderStride(const int width) noexcept {
+    const int line = 64 / sizeof(pixel_t);
+    return ((width + line - 1) / line + 2) * line;
+}
+
+template<typename pixel_t>
+static void borderRows(const pixel_t * (&rows)[3], const int width, pixel_t * scratchp) noexcept {
+    const int rowStride = borderStride<pixel_t>(width);
+    scratchp += 64 / sizeof(pixel_t);
+
+    for (int n = 0; n < 3; n++) {
+        pixel_t * row = scratchp + rowStride * n;
+        std::memcpy(row, rows[n], width * sizeof(pixel_t));
+        border(row, width);
+        rows[n] = row;
+    }
+}
+
+template<typename isa, typename pixel_t>
+void filterRow_simd(const void * above, const void * srcp, const void * below, void * dstp, const int width, const int plane,
+                    const CASKernel * const VS_RESTRICT data) noexcept {
+    const pixel_t * rows[] = { static_cast<const pixel_t *>(above), static_cast<const pixel_t *>(srcp), static_cast<const pixel_t *>(below) };
+    CASScratch scratch{ (borderStride<pixel_t>(width) * 3 + 64 / sizeof(pixel_t)) * sizeof(pixel_t) };
+    borderRows(rows, width, scratch.get<pixel_t>());
+    byPlaneKind<pixel_t>(plane, [&](auto chroma) noexcept {
+        filterRow<isa, pixel_t, decltype(chroma)::value>(rows[0], rows[1], rows[2], static_cast<pixel_t *>(dstp), width, data);
+    });
+}
+
+template<typename isa, typename pixel_t>
+void analyzeRow_simd(const void * above, const void * srcp, const void * below, void * dstp, const int width, const int plane,
+                     const CASKernel * const VS_RESTRICT data, CASStats * stats) noexcept {
+    const pixel_t * rows[] = { static_cast<const pixel_t *>(above), static_cast<const pixel_t *>(srcp), static_cast<const pixel_t *>(below) };
+    CASScratch scratch{ (borderStride<pixel_t>(width) * 3 + 64 / sizeof(pixel_t)) * sizeof(pixel_t) };
+    borderRows(rows, width, scratch.get<pixel_t>());
+    byPlaneKind<pixel_t>(plane, [&](auto chroma) noexcept {
+        if (dstp)
+            filterRow<isa, pixel_t, decltype(chroma)::value, true>(rows[0], rows[1], rows[2], static_cast<pixel_t *>(dstp), width, data, stats);
+        else
+            filterRow<isa, pixel_t, decltype(chroma)::value, true, false>(rows[0], rows[1], rows[2], nullptr, width, data, stats);
+    });
+}
+
+template<typename isa, typename pixel_t>
+void upscale_simd(const CASPlanes & planes, const CASKernel * const VS_RESTRICT data) noexcept {
+    using vec_t = std::conditional_t<std::is_integral_v<pixel_t>, typename isa::Vi, typename isa::Vf>;
+    using Vi = typename isa::Vi;
+    using Vf = typename isa::Vf;
+
+    auto loadf = [](const pixel_t * srcp) noexcept {
+        if constexpr (std::is_integral_v<pixel_t>)
+            return to_float(load<isa>(srcp));
+        else
+            return load<isa>(srcp);
+    };
+
+    // When upscaling, the taps of a vector of destination samples always lie within a window of two vectors of source samples.
+    auto window = [](const Vi index, const float * srcp) noexcept {
+        return isa::window(index, srcp);
+    };
+
+    for (int plane = 0; plane < data->numPlanes; plane++) {
+        const int srcWidth = planes.width[plane];
+        const int srcHeight = planes.height[plane];
+        const int dstWidth = planes.dstWidth[plane];
+        const int dstHeight = planes.dstHeight[plane];
+        const ptrdiff_t srcStride = planes.srcStride[plane];
+        const ptrdiff_t dstStride = planes.dstStride[plane];
+        const pixel_t * srcp = static_cast<const pixel_t *>(planes.srcp[plane]);
+        pixel_t * dstp = static_cast<pixel_t *>(planes.dstp[plane]);
+
+        // Samples are normalized to [0, 1] so that the reference constants apply unchanged.
+        const float scale = std::is_integral_v<pixel_t> ? 1.0f / data->peak : 1.0f;
+        const float bias = (std::is_floating_point_v<pixel_t> && plane && !data->rgb) ? 0.5f : 0.0f;
+        const float outScale = std::is_integral_v<pixel_t> ? static_cast<float>(data->peak) : 1.0f;
+
+        // Ring of four converted source rows, each padded by one mirrored sample on both sides.
+        const int rowSize = ((srcWidth + 2) & ~(vec_t().size() - 1)) + vec_t().size() * 3;
+        CASScratch buffer{ rowSize * 12 * sizeof(float) };
+        float * valuep[4], * weightp[4], * thinp[4];
+        int tag[4] = { -1, -1, -1, -1 };
+        for (int i = 0; i < 4; i++) {
+            valuep[i] = buffer.get<float>() + rowSize * i + 1;
+            weightp[i] = buffer.get<float>() + rowSize * (i + 4);
+            thinp[i] = buffer.get<float>() + rowSize * (i + 8);
+        }
+
+        auto prepare = [&](const int y) noexcept {
+            const int slot = y & 3;
+            if (tag[slot] == y)
+                return slot;
+            tag[slot] = y;
+
+            const pixel_t * row = srcp + y * srcStride;
+            const pixel_t * above = row + (y == 0 ? srcStride : -srcStride);
+            const pixel_t * below = row + (y == srcHeight - 1 ? -srcStride : srcStride);
+            float * v = valuep[slot];
+
+            for (int x = 0; x < srcWidth; x += vec_t().size())
+                mul_add(loadf(row + x), scale, bias).store(v + x);
+            v[-1] = v[1];
+            v[srcWidth] = v[srcWidth - 2];
+
+            for (int x = 0; x < srcWidth; x += vec_t().size()) {
+                if (data->process[plane]) {
+                    const Vf b = mul_add(loadf(above + x), scale, bias);
+                    const Vf h = mul_add(loadf(below + x), scale, bias);
+                    const Vf d = Vf().load(v + x - 1);
+                    const Vf e = Vf().load(v + x);
+                    const Vf f = Vf().load(v + x + 1);
+
+                    const Vf mn = min(min(min(d, e), min(f, b)), h);
+                    const Vf mx = max(max(max(d, e), max(f, b)), h);
+
+                    // Smooth minimum distance to signal limit divided by smooth max, shaped and scaled by the sharpening peak.
+                    const Vf amp = min(max(min(mn, 1.0f - mx) / mx, 0.0f), 1.0f);
+                    (sqrt(amp) * data->sharpness).store(weightp[slot] + x);
+                    // Thin edges to hide bilinear interpolation.
+                    (1.0f / (1.0f / 32.0f + mx - mn)).store(thinp[slot] + x);
+                } else {
+                    Vf(0.0f).store(weightp[slot] + x);
+                    Vf(1.0f).store(thinp[slot] + x);
+                }
+            }
+
+            return slot;
+        };
+
+        for (int y = 0; y < dstHeight; y++) {
+            const int iy = data->rows[plane].index[y];
+            const Vf fy = data->rows[plane].frac[y];
+
+            const float * r0 = valuep[prepare(iy == 0 ? 1 : iy - 1)];
+            const int s1 = prepare(iy);
+            const int s2 = prepare(iy + 1);
+            const float * r3 = valuep[prepare(iy + 2 == srcHeight ? srcHeight - 2 : iy + 2)];
+            const float * r1 = valuep[s1];
+            const float * r2 = valuep[s2];
+
+            for (int x = 0; x < dstWidth; x += vec_t().size()) {
+                // Window starts one sample left of the first tap.
+                const int base = data->columns[plane].index[x] - 1;
+                const Vi ix = Vi().load(data->columns[plane].index.data() + x) - base;
+                const Vf fx = Vf().load(data->columns[plane].frac.data() + x);
+
+                //    b c
+                //  e f g h
+                //  i j k l
+                //    n o
+                const Vf b = window(ix, r0 + base), c = window(ix + 1, r0 + base);
+                const Vf e = window(ix - 1, r1 + base), f = window(ix, r1 + base), g = window(ix + 1, r1 + base), h = window(ix + 2, r1 + base);
+                const Vf i = window(ix - 1, r2 + base), j = window(ix, r2 + base), k = window(ix + 1, r2 + base), l = window(ix + 2, r2 + base);
+                const Vf n = window(ix, r3 + base), o = window(ix + 1, r3 + base);
+
+                const Vf wf = window(ix, weightp[s1] + base), wg = window(ix + 1, weightp[s1] + base);
+                const Vf wj = window(ix, weightp[s2] + base), wk = window(ix + 1, weightp[s2] + base);
+
+                // Blend between the 4 sharpened results.
+                //  s t
+                //  u v
+                const Vf s = (1.0f - fx) * (1.0f - fy) * window(ix, thinp[s1] + base);
+                const Vf t = fx * (1.0f - fy) * window(ix + 1, thinp[s1] + base);
+                const Vf u = (1.0f - fx) * fy * window(ix, thinp[s2] + base);
+                const Vf v = fx * fy * window(ix + 1, thinp[s2] + base);
+
+                const Vf qbe = wf * s;
+                const Vf qch = wg * t;
+                const Vf qf = mul_add(wg, t, mul_add(wj, u, s));
+                const Vf qg = mul_add(wf, s, mul_add(wk, v, t));
+                const Vf qj = mul_add(wf, s, mul_add(wk, v, u));
+                const Vf qk = mul_add(wg, t, mul_add(wj, u, v));
+                const Vf qin = wj * u;
+                const Vf qlo = wk * v;
+
+                const Vf rcp = 1.0f / mul_add(2.0f, (qbe + qch) + (qin + qlo), (qf + qg) + (qj + qk));
+                Vf result = mul_add(b + e, qbe, mul_add(c + h, qch, mul_add(i + n, qin, mul_add(l + o, qlo, mul_add(f, qf, mul_add(g, qg, mul_add(j, qj, k * qk)))))));
+                result = min(max(result * rcp, 0.0f), 1.0f);
+
+                store<isa>(std::is_integral_v<pixel_t> ? result * outScale : result - bias, dstp + x, data->peak);
+            }
+
+            dstp += dstStride;
+        }
+    }
+}
+
@@ -0,0 +1,479 @@
+/*
+    MIT License
+
+    Copyright (c) 2020 Holy Wu
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+// Sharpens a Y4M stream from stdin to stdout, for encoding pipes without VapourSynth. Frames go through a bounded pipeline: one
+// thread reads, the worker threads sharpen, and the main thread writes them back in order.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "libcas.h"
+
+static constexpr size_t ioBufferSize = 1 << 24;
+
+struct Y4MFormat final {
+    int width, height;
+    int numPlanes;
+    int subSamplingW, subSamplingH;
+    int bitsPerSample;
+};
+
+struct Y4MPlanes final {
+    int width[3], height[3];
+    ptrdiff_t stride[3];
+    size_t offset[3];
+    size_t size;
+};
+
+struct Y4MFrame final {
+    std::unique_ptr<uint8_t[]> memory;
+    uint8_t * src[3];
+    uint8_t * dst[3];
+    std::string parameters;
+    bool done;
+};
+
+struct Pipeline final {
+    const CASContext * context;
+    Y4MFormat format;
+    Y4MPlanes srcPlanes, dstPlanes;
+    std::vector<Y4MFrame> frames;
+    std::mutex mutex;
+    std::condition_variable cond;
+    int64_t read, next, written;
+    bool eof;
+    const char * error;
+};
+
+// Every row is 64 byte aligned and padded to a multiple of 64 bytes, so the kernels work on the frames directly.
+static Y4MPlanes planeLayout(const Y4MFormat & format, const int width, const int height) noexcept {
+    const int bytesPerSample = format.bitsPerSample > 8 ? 2 : 1;
+
+    Y4MPlanes planes = {};
+    for (int plane = 0; plane < format.numPlanes; plane++) {
+        planes.width[plane] = width >> (plane ? format.subSamplingW : 0);
+        planes.height[plane] = height >> (plane ? format.subSamplingH : 0);
+        planes.stride[plane] = (planes.width[plane] * bytesPerSample + 63) & ~63;
+        planes.offset[plane] = planes.size;
+        planes.size += planes.stride[plane] * planes.height[plane];
+    }
+    return planes;
+}
+
+static Y4MFormat parseColorspace(const std::string & tag) {
+    Y4MFormat format = {};
+    std::string layout = tag;
+    format.bitsPerSample = 8;
+
+    if (tag == "420jpeg" || tag == "420paldv" || tag == "420mpeg2") {
+        layout = "420";
+    } else {
+        const size_t digits = tag.find_first_of("0123456789", tag.compare(0, 4, "mono") ? 3 : 4);
+        if (digits != std::string::npos) {
+            layout = tag.substr(0, digits);
+            format.bitsPerSample = std::atoi(tag.c_str() + digits);
+            if (layout.back() == 'p')
+                layout.pop_back();
+        }
+    }
+
+    if (layout == "420") {
+        format.numPlanes = 3;
+        format.subSamplingW = format.subSamplingH = 1;
+    } else if (layout == "422") {
+        format.numPlanes = 3;
+        format.subSamplingW = 1;
+    } else if (layout == "444") {
+        format.numPlanes = 3;
+    } else if (layout == "mono") {
+        format.numPlanes = 1;
+    } else {
+        throw "unsupported colorspace";
+    }
+
+    if (format.bitsPerSample < 8 || format.bitsPerSample > 16)
+        throw "unsupported bit depth";
+
+    return format;
+}
+
+static bool readLine(std::FILE * file, std::string & line) noexcept {
+    line.clear();
+    for (int c; (c = std::getc(file)) != '\n'; ) {
+        if (c == EOF || line.size() > 4096)
+            return false;
+        line += static_cast<char>(c);
+    }
+    return true;
+}
+
+// Parses the stream header, and returns it with the dimensions replaced by the output dimensions.
+static std::string parseHeader(const std::string & header, Y4MFormat & format, int & dstWidth, int & dstHeight) {
+    if (header.compare(0, 10, "YUV4MPEG2 "))
+        throw "input is not a Y4M stream";
+
+    std::string colorspace = "420jpeg";
+    std::string output = "YUV4MPEG2";
+    std::vector<std::string> tags;
+
+    for (size_t begin = 10, end; begin < header.size(); begin = end + 1) {
+        end = std::min(header.find(' ', begin), header.size());
+        if (end > begin)
+            tags.push_back(header.substr(begin, end - begin));
+    }
+
+    for (const auto & tag : tags) {
+        if (tag[0] == 'W')
+            format.width = std::atoi(tag.c_str() + 1);
+        else if (tag[0] == 'H')
+            format.height = std::atoi(tag.c_str() + 1);
+        else if (tag[0] == 'C')
+            colorspace = tag.substr(1);
+    }
+
+    const int width = format.width;
+    const int height = format.height;
+    format = parseColorspace(colorspace);
+    format.width = width;
+    format.height = height;
+
+    if (format.width <= 0 || format.height <= 0)
+        throw "missing or invalid frame dimensions";
+
+    if (!dstWidth)
+        dstWidth = format.width;
+    if (!dstHeight)
+        dstHeight = format.height;
+
+    for (const auto & tag : tags) {
+        if (tag[0] == 'W')
+            output += " W" + std::to_string(dstWidth);
+        else if (tag[0] == 'H')
+            output += " H" + std::to_string(dstHeight);
+        else
+            output += " " + tag;
+    }
+    return output + "\n";
+}
+
+// Whole planes are transferred at once when their rows have no padding, which lets stdio bypass its buffer for large frames.
+static bool transferPlanes(std::FILE * file, uint8_t * const * planes, const Y4MPlanes & layout, const int numPlanes, const int bytesPerSample,
+                           const bool write) noexcept {
+    for (int plane = 0; plane < numPlanes; plane++) {
+        const size_t rowSize = static_cast<size_t>(layout.width[plane]) * bytesPerSample;
+        const int rows = rowSize == static_cast<size_t>(layout.stride[plane]) ? 1 : layout.height[plane];
+        const size_t size = rows == 1 ? rowSize * layout.height[plane] : rowSize;
+
+        for (int y = 0; y < rows; y++) {
+            uint8_t * p = planes[plane] + y * layout.stride[plane];
+            if ((write ? std::fwrite(p, 1, size, file) : std::fread(p, 1, size, file)) != size)
+                return false;
+        }
+    }
+    return true;
+}
+
+static void readFrames(Pipeline * d) noexcept {
+    const int bytesPerSample = d->format.bitsPerSample > 8 ? 2 : 1;
+    const int64_t queue = static_cast<int64_t>(d->frames.size());
+    std::string line;
+
+    for (int64_t n = 0;; n++) {
+        {
+            std::unique_lock<std::mutex> lock(d->mutex);
+            d->cond.wait(lock, [&] { return n - d->written < queue || d->error; });
+            if (d->error)
+                return;
+        }
+
+        Y4MFrame & frame = d->frames[n % queue];
+        const char * error = nullptr;
+
+        if (!readLine(stdin, line)) {
+            if (!line.empty() || std::ferror(stdin))
+                error = "truncated frame header";
+        } else if (line.compare(0, 5, "FRAME")) {
+            error = "invalid frame header";
+        } else {
+            frame.parameters = line.substr(5);
+            frame.done = false;
+            if (!transferPlanes(stdin, frame.src, d->srcPlanes, d->format.numPlanes, bytesPerSample, false))
+                error = "truncated frame";
+        }
+
+        std::lock_guard<std::mutex> lock(d->mutex);
+        if (error || line.empty()) {
+            d->error = error;
+            d->eof = true;
+        } else {
+            d->read++;
+        }
+        d->cond.notify_all();
+        if (d->eof)
+            return;
+    }
+}
+
+static void processFrames(Pipeline * d) noexcept {
+    const int64_t queue = static_cast<int64_t>(d->frames.size());
+    std::vector<uint8_t> scratch(cas_scratch_size(d->context));
+
+    for (;;) {
+        int64_t n;
+        {
+            std::unique_lock<std::mutex> lock(d->mutex);
+            d->cond.wait(lock, [&] { return d->next < d->read || d->eof; });
+            if (d->next >= d->read)
+                return;
+            n = d->next++;
+        }
+
+        Y4MFrame & frame = d->frames[n % queue];
+        const void * src[3] = { frame.src[0], frame.src[1], frame.src[2] };
+        void * dst[3] = { frame.dst[0], frame.dst[1], frame.dst[2] };
+        const char * error = cas_process(d->context, src, d->srcPlanes.stride, dst, d->dstPlanes.stride, scratch.data());
+
+        std::lock_guard<std::mutex> lock(d->mutex);
+        frame.done = true;
+        if (error && !d->error)
+            d->error = error;
+        d->cond.notify_all();
+    }
+}
+
+static void usage() noexcept {
+    std::fprintf(stderr,
+                 "Usage: cas-y4m [options] < input.y4m > output.y4m\n"
+                 "\n"
+                 "  --sharpness F     sharpening strength, 0.0-1.0 (default 0.5)\n"
+                 "  --planes LIST     comma separated planes to sharpen (default 0)\n"
+                 "  --shared-amp      compute the amplitude once from luma\n"
+                 "  --amp-scale N     1 or 2, the block size of the amplitude (default 1)\n"
+                 "  --fields          sharpen the two fields of interlaced frames separately\n"
+                 "  --linear TRANSFER sharpen in linear light, with TRANSFER 709, srgb or st2084\n"
+                 "  --width W         upscaled output width\n"
+                 "  --height H        upscaled output height\n"
+                 "  --opt N           0 = auto, 1 = c, 2 = sse2, 3 = avx2, 4 = avx512\n"
+                 "  --threads N       worker threads (default: all cores)\n"
+                 "  --huge-pages      back the kernels' scratch memory with transparent huge pages\n");
+}
+
+int main(int argc, char ** argv) {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    std::setvbuf(stdin, nullptr, _IOFBF, ioBufferSize);
+    std::setvbuf(stdout, nullptr, _IOFBF, ioBufferSize);
+
+    Pipeline d = {};
+    CASContext * context = nullptr;
+    int threads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+
+    try {
+        float sharpness = 0.5f;
+        int planes = -1, sharedAmp = 0, ampScale = 1, fields = 0, linear = 0, dstWidth = 0, dstHeight = 0, opt = 0, hugePages = 0;
+
+        for (int i = 1; i < argc; i++) {
+            const std::string option = argv[i];
+
+            if (option == "--help" || option == "-h") {
+                usage();
+                return 0;
+            }
+
+            if (option == "--shared-amp") {
+                sharedAmp = 1;
+                continue;
+            }
+
+            if (option == "--fields") {
+                fields = 1;
+                continue;
+            }
+
+            if (option == "--huge-pages") {
+                hugePages = 1;
+                continue;
+            }
+
+            if (i + 1 >= argc)
+                throw "missing option value";
+            const char * value = argv[++i];
+
+            if (option == "--sharpness") {
+                sharpness = static_cast<float>(std::atof(value));
+            } else if (option == "--planes") {
+                planes = 0;
+                for (const char * p = value; *p; p += *p == ',') {
+                    char * end;
+                    const long n = std::strtol(p, &end, 10);
+                    if (end == p || n < 0 || n > 2)
+                        throw "plane index out of range";
+                    if (planes & (1 << n))
+                        throw "plane specified twice";
+                    planes |= 1 << n;
+                    p = end;
+                }
+            } else if (option == "--linear") {
+                const std::string transfer = value;
+                if (transfer == "709")
+                    linear = 1;
+                else if (transfer == "srgb")
+                    linear = 2;
+                else if (transfer == "st2084")
+                    linear = 3;
+                else
+                    throw "transfer must be 709, srgb or st2084";
+            } else if (option == "--amp-scale") {
+                ampScale = std::atoi(value);
+            } else if (option == "--width") {
+                dstWidth = std::atoi(value);
+            } else if (option == "--height") {
+                dstHeight = std::atoi(value);
+            } else if (option == "--opt") {
+                opt = std::atoi(value);
+            } else if (option == "--threads") {
+                threads = std::atoi(value);
+                if (threads < 1)
+                    throw "threads must be greater than or equal to 1";
+            } else {
+                usage();
+                throw "unknown option";
+            }
+        }
+
+        std::string header;
+        if (!readLine(stdin, header))
+            throw "missing stream header";
+        header = parseHeader(header, d.format, dstWidth, dstHeight);
+
+        CASConfig config;
+        cas_default_config(&config, d.format.width, d.format.height, d.format.numPlanes, d.format.subSamplingW, d.format.subSamplingH,
+                           d.format.bitsPerSample, 0, 0);
+        if (planes >= 0)
+            config.planes = planes;
+        config.sharpness = sharpness;
+        config.shared_amp = sharedAmp;
+        config.amp_scale = ampScale;
+        config.fields = fields;
+        config.linear = linear;
+        if (dstWidth != d.format.width || dstHeight != d.format.height) {
+            config.dst_width = dstWidth;
+            config.dst_height = dstHeight;
+        }
+        config.padded = 1;
+        config.opt = opt;
+        config.huge_pages = hugePages;
+
+        const char * error;
+        if (!(context = cas_create(&config, &error)))
+            throw error;
+
+        std::fputs(header.c_str(), stdout);
+
+        d.context = context;
+        d.srcPlanes = planeLayout(d.format, d.format.width, d.format.height);
+        d.dstPlanes = planeLayout(d.format, dstWidth, dstHeight);
+
+        // Two frames per worker keep every thread busy while the reader and writer catch up, and bound the memory.
+        d.frames.resize(threads * 2);
+        for (auto & frame : d.frames) {
+            frame.memory = std::make_unique<uint8_t[]>(d.srcPlanes.size + d.dstPlanes.size + 64);
+            uint8_t * base = reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(frame.memory.get()) + 63) & ~static_cast<uintptr_t>(63));
+            for (int plane = 0; plane < d.format.numPlanes; plane++) {
+                frame.src[plane] = base + d.srcPlanes.offset[plane];
+                frame.dst[plane] = base + d.srcPlanes.size + d.dstPlanes.offset[plane];
+            }
+        }
+    } catch (const char * error) {
+        std::fprintf(stderr, "cas-y4m: %s\n", error);
+        cas_free(context);
+        return 1;
+    }
+
+    std::vector<std::thread> workers;
+    std::thread reader(readFrames, &d);
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back(processFrames, &d);
+
+    const int bytesPerSample = d.format.bitsPerSample > 8 ? 2 : 1;
+    const int64_t queue = static_cast<int64_t>(d.frames.size());
+
+    for (int64_t n = 0;; n++) {
+        Y4MFrame & frame = d.frames[n % queue];
+        {
+            std::unique_lock<std::mutex> lock(d.mutex);
+            d.cond.wait(lock, [&] { return (n < d.read && frame.done) || (d.eof && n >= d.read) || d.error; });
+            if (d.error || n >= d.read)
+                break;
+        }
+
+        const bool written = std::fputs(("FRAME" + frame.parameters + "\n").c_str(), stdout) >= 0 &&
+                             transferPlanes(stdout, frame.dst, d.dstPlanes, d.format.numPlanes, bytesPerSample, true);
+
+        std::lock_guard<std::mutex> lock(d.mutex);
+        if (!written)
+            d.error = "failed to write the output";
+        d.written++;
+        d.cond.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(d.mutex);
+        d.eof = true;
+        d.cond.notify_all();
+    }
+
+    reader.join();
+    for (auto & worker : workers)
+        worker.join();
+
+    cas_free(context);
+
+    if (std::fflush(stdout) && !d.error)
+        d.error = "failed to write the output";
+
+    if (d.error) {
+        std::fprintf(stderr, "cas-y4m: %s\n", d.error);
+        return 1;
+    }
+    return 0;
+}
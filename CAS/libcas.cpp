@@ -0,0 +1,1358 @@
+/*
+    MIT License
+
+    Copyright (c) 2020 Holy Wu
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "CASKernel.h"
+
+#ifdef CAS_X86
+// The SIMD kernels, instantiated for each instruction set by its translation unit.
+struct CASSSE2;
+struct CASAVX2;
+struct CASAVX512;
+
+template<typename isa, typename pixel_t> extern void filter_simd(const CASPlanes & planes, const CASKernel * const VS_RESTRICT data) noexcept;
+template<typename isa, typename pixel_t> extern void upscale_simd(const CASPlanes & planes, const CASKernel * const VS_RESTRICT data) noexcept;
+template<typename isa, typename pixel_t> extern void filterRow_simd(const void * above, const void * srcp, const void * below, void * dstp, const int width,
+                                                                    const int plane, const CASKernel * const VS_RESTRICT data) noexcept;
+template<typename isa, typename pixel_t> extern void analyzeRow_simd(const void * above, const void * srcp, const void * below, void * dstp, const int width,
+                                                                     const int plane, const CASKernel * const VS_RESTRICT data, CASStats * stats) noexcept;
+#endif
+
+// Each thread keeps one arena for the scratch memory of every kernel and instance. Scratch is taken from its end and given back in reverse
+// order. A request that does not fit while other scratch is taken gets a block of its own, and the arena is reallocated at the largest size
+// the thread has needed the next time it is empty, so after the first frames no call allocates.
+struct CASArena final {
+    uint8_t * memory = nullptr;
+    size_t size = 0;
+    size_t alignment = 0;
+    size_t used = 0;
+    size_t inUse = 0;
+    size_t needed = 0;
+    size_t peak = 0;
+
+    ~CASArena() {
+        if (memory)
+            ::operator delete(memory, std::align_val_t{ alignment });
+    }
+};
+
+static std::atomic<size_t> scratchReserved{ 0 };
+static std::atomic<bool> scratchHugePages{ false };
+static std::atomic<size_t> scratchPeak{ 0 };
+static thread_local CASArena arena;
+
+static void growArena(CASArena & a) {
+    const size_t hugePage = 2 << 20;
+    size_t size = std::max(a.needed, scratchReserved.load(std::memory_order_relaxed));
+    size_t alignment = 64;
+#ifdef __linux__
+    // Transparent huge pages are only used for whole, aligned huge pages.
+    if (scratchHugePages.load(std::memory_order_relaxed)) {
+        size = (size + hugePage - 1) & ~(hugePage - 1);
+        alignment = hugePage;
+    }
+#endif
+
+    if (a.memory)
+        ::operator delete(a.memory, std::align_val_t{ a.alignment });
+    a.memory = static_cast<uint8_t *>(::operator new(size, std::align_val_t{ alignment }));
+    a.size = size;
+    a.alignment = alignment;
+
+#ifdef __linux__
+    if (alignment == hugePage)
+        madvise(a.memory, size, MADV_HUGEPAGE);
+#endif
+}
+
+CASScratch::CASScratch(size_t size) noexcept : offset(arena.used) {
+    CASArena & a = arena;
+    size = (size + 63) & ~static_cast<size_t>(63);
+    this->size = size;
+
+    a.needed = std::max(a.needed, a.inUse + size);
+    if (!a.used && (a.size < a.needed || a.size < scratchReserved.load(std::memory_order_relaxed)))
+        growArena(a);
+
+    if (a.used + size <= a.size) {
+        pointer = a.memory + a.used;
+        a.used += size;
+    } else {
+        pointer = ::operator new(size, std::align_val_t{ 64 });
+        offset = SIZE_MAX;
+    }
+
+    a.inUse += size;
+    if (a.inUse > a.peak) {
+        a.peak = a.inUse;
+        size_t peak = scratchPeak.load(std::memory_order_relaxed);
+        while (peak < a.peak && !scratchPeak.compare_exchange_weak(peak, a.peak, std::memory_order_relaxed)) {
+        }
+    }
+}
+
+CASScratch::~CASScratch() {
+    CASArena & a = arena;
+    if (offset == SIZE_MAX)
+        ::operator delete(pointer, std::align_val_t{ 64 });
+    else
+        a.used = offset;
+    a.inUse -= size;
+}
+
+void casReserveScratch(const size_t size, const bool hugePages) noexcept {
+    size_t reserved = scratchReserved.load(std::memory_order_relaxed);
+    while (reserved < size && !scratchReserved.compare_exchange_weak(reserved, size, std::memory_order_relaxed)) {
+    }
+
+    if (hugePages)
+        scratchHugePages.store(true, std::memory_order_relaxed);
+}
+
+size_t casScratchPeak() noexcept {
+    return scratchPeak.load(std::memory_order_relaxed);
+}
+
+template<typename var_t>
+static inline void softMinMax(const var_t a, const var_t b, const var_t c, const var_t d, const var_t e, const var_t f, const var_t g, const var_t h, const var_t i,
+                              var_t & mn, var_t & mx) noexcept {
+    // Soft min and max.
+    //  a b c             b
+    //  d e f * 0.5  +  d e f * 0.5
+    //  g h i             h
+    // These are 2.0x bigger (factored out the extra multiply).
+    mn = std::min({ d, e, f, b, h });
+    const var_t mn2 = std::min({ mn, a, c, g, i });
+    mn += mn2;
+
+    mx = std::max({ d, e, f, b, h });
+    const var_t mx2 = std::max({ mx, a, c, g, i });
+    mx += mx2;
+}
+
+template<typename var_t>
+static inline float amplitude(var_t mn, var_t mx, const var_t limit, const float chromaOffset) noexcept {
+    if constexpr (std::is_floating_point_v<var_t>) {
+        mn += chromaOffset;
+        mx += chromaOffset;
+    }
+
+    // Smooth minimum distance to signal limit divided by smooth max.
+    float amp = std::clamp(std::min(mn, limit - mx) / static_cast<float>(mx), 0.0f, 1.0f);
+
+    // Shaping amount of sharpening.
+    return std::sqrt(amp);
+}
+
+template<typename var_t>
+static inline float amplitude(const var_t a, const var_t b, const var_t c, const var_t d, const var_t e, const var_t f, const var_t g, const var_t h, const var_t i,
+                              const var_t limit, const float chromaOffset) noexcept {
+    var_t mn, mx;
+    softMinMax(a, b, c, d, e, f, g, h, i, mn, mx);
+    return amplitude(mn, mx, limit, chromaOffset);
+}
+
+template<typename pixel_t>
+static inline void store(const float result, pixel_t * dstp, const int peak) noexcept {
+    if constexpr (std::is_integral_v<pixel_t>)
+        *dstp = std::clamp(static_cast<int>(result + 0.5f), 0, peak);
+    else
+        *dstp = result;
+}
+
+template<typename pixel_t, bool statistics = false, bool output = true>
+static inline void filterRow(const pixel_t * above, const pixel_t * srcp, const pixel_t * below, pixel_t * VS_RESTRICT dstp, const int width,
+                             const int plane, const CASKernel * const VS_RESTRICT data, CASStats * stats = nullptr) noexcept {
+    using var_t = std::conditional_t<std::is_integral_v<pixel_t>, int, float>;
+
+    const var_t limit = std::any_cast<var_t>(data->limit);
+    const float chromaOffset = plane ? 1.0f : 0.0f;
+
+    const bool chroma = plane && !data->rgb;
+    const float low = std::is_integral_v<pixel_t> ? -0.5f : (chroma ? -0.5f : data->clipLow);
+    const float high = std::is_integral_v<pixel_t> ? data->peak + 0.5f : (chroma ? 0.5f : data->clipHigh);
+
+    auto filtering = [&](const var_t a, const var_t b, const var_t c, const var_t d, const var_t e, const var_t f, const var_t g, const var_t h, const var_t i) noexcept {
+        // Filter shape.
+        //  0 w 0
+        //  w 1 w
+        //  0 w 0
+        const float amp = amplitude(a, b, c, d, e, f, g, h, i, limit, chromaOffset);
+        const float weight = amp * data->sharpness;
+        const float result = ((b + d + f + h) * weight + e) / (1.0f + 4.0f * weight);
+
+        if constexpr (statistics) {
+            // A window with a zero maximum has no amplitude.
+            const float measured = amp >= 0.0f ? amp : 0.0f;
+            stats->ampSum += measured;
+            stats->histogram[std::min(static_cast<int>(measured * 8.0f), 7)]++;
+            stats->clipped += result < low || result > high;
+        }
+
+        return result;
+    };
+
+    if constexpr (statistics)
+        stats->count += width;
+
+    {
+        const float result = filtering(above[1], above[0], above[1],
+                                       srcp[1], srcp[0], srcp[1],
+                                       below[1], below[0], below[1]);
+
+        if constexpr (output)
+            store(result, dstp + 0, data->peak);
+    }
+
+    for (int x = 1; x < width - 1; x++) {
+        const float result = filtering(above[x - 1], above[x], above[x + 1],
+                                       srcp[x - 1], srcp[x], srcp[x + 1],
+                                       below[x - 1], below[x], below[x + 1]);
+
+        if constexpr (output)
+            store(result, dstp + x, data->peak);
+    }
+
+    {
+        const float result = filtering(above[width - 2], above[width - 1], above[width - 2],
+                                       srcp[width - 2], srcp[width - 1], srcp[width - 2],
+                                       below[width - 2], below[width - 1], below[width - 2]);
+
+        if constexpr (output)
+            store(result, dstp + width - 1, data->peak);
+    }
+}
+
+template<typename pixel_t>
+static void filterRow_c(const void * above, const void * srcp, const void * below, void * dstp, const int width, const int plane,
+                        const CASKernel * const VS_RESTRICT data) noexcept {
+    filterRow(static_cast<const pixel_t *>(above), static_cast<const pixel_t *>(srcp), static_cast<const pixel_t *>(below), static_cast<pixel_t *>(dstp), width,
+              plane, data);
+}
+
+template<typename pixel_t>
+static void analyzeRow_c(const void * above, const void * srcp, const void * below, void * dstp, const int width, const int plane,
+                         const CASKernel * const VS_RESTRICT data, CASStats * stats) noexcept {
+    if (dstp)
+        filterRow<pixel_t, true>(static_cast<const pixel_t *>(above), static_cast<const pixel_t *>(srcp), static_cast<const pixel_t *>(below),
+                                 static_cast<pixel_t *>(dstp), width, plane, data, stats);
+    else
+        filterRow<pixel_t, true, false>(static_cast<const pixel_t *>(above), static_cast<const pixel_t *>(srcp), static_cast<const pixel_t *>(below), nullptr,
+                                        width, plane, data, stats);
+}
+
+template<typename pixel_t>
+static void filter_c(const CASPlanes & planes, const CASKernel * const VS_RESTRICT data) noexcept {
+    using var_t = std::conditional_t<std::is_integral_v<pixel_t>, int, float>;
+
+    if (data->sharedAmp) {
+        // Amplitude is computed once per pixel from the guide plane (G for RGB, Y otherwise) and shared by every processed plane.
+        // Subsampled chroma takes the amplitude of the co-sited luma sample.
+        const int guide = data->rgb ? 1 : 0;
+        const int ssw = data->subSamplingW;
+        const int ssh = data->subSamplingH;
+
+        const int width = planes.width[guide];
+        const int height = planes.height[guide];
+        const ptrdiff_t guideStride = planes.srcStride[guide];
+        const pixel_t * guidep = static_cast<const pixel_t *>(planes.srcp[guide]);
+
+        const var_t limit = std::any_cast<var_t>(data->limit);
+        const float chromaOffset = guide ? 1.0f : 0.0f;
+
+        CASScratch buffer{ width * 2 * sizeof(float) };
+        float * VS_RESTRICT weightp = buffer.get<float>();
+        float * VS_RESTRICT rcpp = weightp + width;
+
+        auto sharpenRow = [&](const int plane, const int y, const int shift) noexcept {
+            const int width = planes.width[plane];
+            const int height = planes.height[plane];
+            const ptrdiff_t stride = planes.srcStride[plane];
+            const ptrdiff_t dstStride = planes.dstStride[plane];
+            const pixel_t * srcp = static_cast<const pixel_t *>(planes.srcp[plane]) + y * stride;
+            pixel_t * VS_RESTRICT dstp = static_cast<pixel_t *>(planes.dstp[plane]) + y * dstStride;
+
+            const pixel_t * above = srcp + (y == 0 ? stride : -stride);
+            const pixel_t * below = srcp + (y == height - 1 ? -stride : stride);
+
+            for (int x = 0; x < width; x++) {
+                const int left = x == 0 ? 1 : x - 1;
+                const int right = x == width - 1 ? width - 2 : x + 1;
+                const float weight = weightp[x << shift];
+                store(((above[x] + srcp[left] + srcp[right] + below[x]) * weight + srcp[x]) * rcpp[x << shift], dstp + x, data->peak);
+            }
+        };
+
+        for (int y = 0; y < height; y++) {
+            const pixel_t * above = guidep + (y == 0 ? guideStride : -guideStride);
+            const pixel_t * below = guidep + (y == height - 1 ? -guideStride : guideStride);
+
+            for (int x = 0; x < width; x++) {
+                const int left = x == 0 ? 1 : x - 1;
+                const int right = x == width - 1 ? width - 2 : x + 1;
+                weightp[x] = amplitude<var_t>(above[left], above[x], above[right],
+                                              guidep[left], guidep[x], guidep[right],
+                                              below[left], below[x], below[right],
+                                              limit, chromaOffset) * data->sharpness;
+                rcpp[x] = 1.0f / (1.0f + 4.0f * weightp[x]);
+            }
+
+            for (int plane = 0; plane < data->numPlanes; plane++) {
+                if (data->process[plane]) {
+                    if (plane == 0 || !(ssw || ssh))
+                        sharpenRow(plane, y, 0);
+                    else if (!(y & ((1 << ssh) - 1)))
+                        sharpenRow(plane, y >> ssh, ssw);
+                }
+            }
+
+            guidep += guideStride;
+        }
+
+        return;
+    }
+
+    if (data->ampScale == 2) {
+        // Amplitude is computed once per 2x2 block from the mean soft minimum and maximum of its samples, and shared by all four.
+        // Summing the four samples' values instead of averaging them only scales the limit and the chroma offset.
+        const var_t limit = std::any_cast<var_t>(data->limit) * 4;
+
+        for (int plane = 0; plane < data->numPlanes; plane++) {
+            if (data->process[plane]) {
+                const int width = planes.width[plane];
+                const int height = planes.height[plane];
+                const ptrdiff_t stride = planes.srcStride[plane];
+                const ptrdiff_t dstStride = planes.dstStride[plane];
+                const pixel_t * srcp = static_cast<const pixel_t *>(planes.srcp[plane]);
+                pixel_t * VS_RESTRICT dstp = static_cast<pixel_t *>(planes.dstp[plane]);
+
+                const float chromaOffset = plane ? 4.0f : 0.0f;
+
+                CASScratch sums{ (width + 1) / 2 * 2 * sizeof(var_t) };
+                var_t * VS_RESTRICT mnp = sums.get<var_t>();
+                var_t * VS_RESTRICT mxp = mnp + (width + 1) / 2;
+
+                CASScratch buffer{ (width + 1) / 2 * 2 * sizeof(float) };
+                float * VS_RESTRICT weightp = buffer.get<float>();
+                float * VS_RESTRICT rcpp = weightp + (width + 1) / 2;
+
+                for (int y = 0; y < height; y += 2) {
+                    std::fill_n(mnp, (width + 1) / 2, 0);
+                    std::fill_n(mxp, (width + 1) / 2, 0);
+
+                    // The last row and column of an odd-sized plane count twice.
+                    for (int sy = y; sy < y + 2; sy++) {
+                        const pixel_t * row = srcp + std::min(sy, height - 1) * stride;
+                        const pixel_t * above = row + (sy == 0 ? stride : -stride);
+                        const pixel_t * below = row + (sy >= height - 1 ? -stride : stride);
+
+                        for (int x = 0; x < width + (width & 1); x++) {
+                            const int sx = std::min(x, width - 1);
+                            const int left = sx == 0 ? 1 : sx - 1;
+                            const int right = sx == width - 1 ? width - 2 : sx + 1;
+
+                            var_t mn, mx;
+                            softMinMax<var_t>(above[left], above[sx], above[right],
+                                              row[left], row[sx], row[right],
+                                              below[left], below[sx], below[right],
+                                              mn, mx);
+                            mnp[x >> 1] += mn;
+                            mxp[x >> 1] += mx;
+                        }
+                    }
+
+                    for (int x = 0; x < (width + 1) / 2; x++) {
+                        weightp[x] = amplitude(mnp[x], mxp[x], limit, chromaOffset) * data->sharpness;
+                        rcpp[x] = 1.0f / (1.0f + 4.0f * weightp[x]);
+                    }
+
+                    for (int sy = y; sy < std::min(y + 2, height); sy++) {
+                        const pixel_t * row = srcp + sy * stride;
+                        const pixel_t * above = row + (sy == 0 ? stride : -stride);
+                        const pixel_t * below = row + (sy == height - 1 ? -stride : stride);
+
+                        for (int x = 0; x < width; x++) {
+                            const int left = x == 0 ? 1 : x - 1;
+                            const int right = x == width - 1 ? width - 2 : x + 1;
+                            store(((above[x] + row[left] + row[right] + below[x]) * weightp[x >> 1] + row[x]) * rcpp[x >> 1], dstp + sy * dstStride + x, data->peak);
+                        }
+                    }
+                }
+            }
+        }
+
+        return;
+    }
+
+    for (int plane = 0; plane < data->numPlanes; plane++) {
+        if (data->process[plane]) {
+            const int width = planes.width[plane];
+            const int height = planes.height[plane];
+            const ptrdiff_t stride = planes.srcStride[plane];
+            const ptrdiff_t dstStride = planes.dstStride[plane];
+            const pixel_t * srcp = static_cast<const pixel_t *>(planes.srcp[plane]);
+            pixel_t * dstp = static_cast<pixel_t *>(planes.dstp[plane]);
+
+            const bool statistics = planes.stats && plane == (data->rgb ? 1 : 0);
+
+            for (int y = 0; y < height; y++) {
+                const pixel_t * above = srcp + (y == 0 ? stride : -stride);
+                const pixel_t * below = srcp + (y == height - 1 ? -stride : stride);
+
+                if (statistics)
+                    filterRow<pixel_t, true>(above, srcp, below, dstp, width, plane, data, planes.stats);
+                else
+                    filterRow(above, srcp, below, dstp, width, plane, data);
+
+                srcp += stride;
+                dstp += dstStride;
+            }
+        }
+    }
+}
+
+template<typename pixel_t>
+static void upscale_c(const CASPlanes & planes, const CASKernel * const VS_RESTRICT data) noexcept {
+    for (int plane = 0; plane < data->numPlanes; plane++) {
+        const int srcWidth = planes.width[plane];
+        const int srcHeight = planes.height[plane];
+        const int dstWidth = planes.dstWidth[plane];
+        const int dstHeight = planes.dstHeight[plane];
+        const ptrdiff_t srcStride = planes.srcStride[plane];
+        const ptrdiff_t dstStride = planes.dstStride[plane];
+        const pixel_t * srcp = static_cast<const pixel_t *>(planes.srcp[plane]);
+        pixel_t * VS_RESTRICT dstp = static_cast<pixel_t *>(planes.dstp[plane]);
+
+        // Samples are normalized to [0, 1] so that the reference constants apply unchanged.
+        const float scale = std::is_integral_v<pixel_t> ? 1.0f / data->peak : 1.0f;
+        const float bias = (std::is_floating_point_v<pixel_t> && plane && !data->rgb) ? 0.5f : 0.0f;
+
+        // Ring of four converted source rows, each padded by one mirrored sample on both sides.
+        const int paddedWidth = srcWidth + 2;
+        CASScratch buffer{ (paddedWidth * 4 + srcWidth * 8) * sizeof(float) };
+        float * valuep[4], * weightp[4], * thinp[4];
+        int tag[4] = { -1, -1, -1, -1 };
+        for (int i = 0; i < 4; i++) {
+            valuep[i] = buffer.get<float>() + paddedWidth * i + 1;
+            weightp[i] = buffer.get<float>() + paddedWidth * 4 + srcWidth * i;
+            thinp[i] = buffer.get<float>() + paddedWidth * 4 + srcWidth * (i + 4);
+        }
+
+        auto prepare = [&](const int y) noexcept {
+            const int slot = y & 3;
+            if (tag[slot] == y)
+                return slot;
+            tag[slot] = y;
+
+            const pixel_t * row = srcp + y * srcStride;
+            const pixel_t * above = row + (y == 0 ? srcStride : -srcStride);
+            const pixel_t * below = row + (y == srcHeight - 1 ? -srcStride : srcStride);
+            float * VS_RESTRICT v = valuep[slot];
+
+            for (int x = 0; x < srcWidth; x++)
+                v[x] = row[x] * scale + bias;
+            v[-1] = v[1];
+            v[srcWidth] = v[srcWidth - 2];
+
+            for (int x = 0; x < srcWidth; x++) {
+                if (data->process[plane]) {
+                    const float b = above[x] * scale + bias;
+                    const float h = below[x] * scale + bias;
+                    const float mn = std::min({ b, v[x - 1], v[x], v[x + 1], h });
+                    const float mx = std::max({ b, v[x - 1], v[x], v[x + 1], h });
+
+                    // Smooth minimum distance to signal limit divided by smooth max, shaped and scaled by the sharpening peak.
+                    weightp[slot][x] = std::sqrt(std::min(std::max(0.0f, std::min(mn, 1.0f - mx) / mx), 1.0f)) * data->sharpness;
+                    // Thin edges to hide bilinear interpolation.
+                    thinp[slot][x] = 1.0f / (1.0f / 32.0f + mx - mn);
+                } else {
+                    weightp[slot][x] = 0.0f;
+                    thinp[slot][x] = 1.0f;
+                }
+            }
+
+            return slot;
+        };
+
+        for (int y = 0; y < dstHeight; y++) {
+            const int iy = data->rows[plane].index[y];
+            const float fy = data->rows[plane].frac[y];
+
+            const int r0 = prepare(iy == 0 ? 1 : iy - 1);
+            const int r1 = prepare(iy);
+            const int r2 = prepare(iy + 1);
+            const int r3 = prepare(iy + 2 == srcHeight ? srcHeight - 2 : iy + 2);
+
+            for (int x = 0; x < dstWidth; x++) {
+                const int ix = data->columns[plane].index[x];
+                const float fx = data->columns[plane].frac[x];
+
+                //    b c
+                //  e f g h
+                //  i j k l
+                //    n o
+                const float b = valuep[r0][ix], c = valuep[r0][ix + 1];
+                const float e = valuep[r1][ix - 1], f = valuep[r1][ix], g = valuep[r1][ix + 1], h = valuep[r1][ix + 2];
+                const float i = valuep[r2][ix - 1], j = valuep[r2][ix], k = valuep[r2][ix + 1], l = valuep[r2][ix + 2];
+                const float n = valuep[r3][ix], o = valuep[r3][ix + 1];
+
+                const float wf = weightp[r1][ix], wg = weightp[r1][ix + 1], wj = weightp[r2][ix], wk = weightp[r2][ix + 1];
+
+                // Blend between the 4 sharpened results.
+                //  s t
+                //  u v
+                const float s = (1.0f - fx) * (1.0f - fy) * thinp[r1][ix];
+                const float t = fx * (1.0f - fy) * thinp[r1][ix + 1];
+                const float u = (1.0f - fx) * fy * thinp[r2][ix];
+                const float v = fx * fy * thinp[r2][ix + 1];
+
+                const float qbe = wf * s;
+                const float qch = wg * t;
+                const float qf = wg * t + wj * u + s;
+                const float qg = wf * s + wk * v + t;
+                const float qj = wf * s + wk * v + u;
+                const float qk = wg * t + wj * u + v;
+                const float qin = wj * u;
+                const float qlo = wk * v;
+
+                const float rcp = 1.0f / (2.0f * (qbe + qch + qin + qlo) + qf + qg + qj + qk);
+                const float result = ((b + e) * qbe + (c + h) * qch + (i + n) * qin + (l + o) * qlo + f * qf + g * qg + j * qj + k * qk) * rcp;
+
+                if constexpr (std::is_integral_v<pixel_t>)
+                    dstp[x] = std::clamp(static_cast<int>(std::clamp(result, 0.0f, 1.0f) * data->peak + 0.5f), 0, data->peak);
+                else
+                    dstp[x] = std::clamp(result, 0.0f, 1.0f) - bias;
+            }
+
+            dstp += dstStride;
+        }
+    }
+}
+
+// The kernels of an instruction set for one sample type.
+struct CASKernels final {
+    decltype(CASKernel::filter) filter;
+    decltype(CASKernel::filter) upscale;
+    decltype(CASKernel::filterRow) filterRow;
+    decltype(CASKernel::analyzeRow) analyzeRow;
+};
+
+template<typename pixel_t>
+static constexpr CASKernels kernels_c = { filter_c<pixel_t>, upscale_c<pixel_t>, filterRow_c<pixel_t>, analyzeRow_c<pixel_t> };
+
+#ifdef CAS_X86
+template<typename isa, typename pixel_t>
+static constexpr CASKernels kernels_simd = { filter_simd<isa, pixel_t>, upscale_simd<isa, pixel_t>, filterRow_simd<isa, pixel_t>, analyzeRow_simd<isa, pixel_t> };
+#endif
+
+// Indexed by instruction set (C, SSE2, AVX2 and AVX-512, in the order of opt) and sample type (8 bit, 16 bit and float).
+static constexpr CASKernels kernelTable[][3] = {
+    { kernels_c<uint8_t>, kernels_c<uint16_t>, kernels_c<float> },
+#ifdef CAS_X86
+    { kernels_simd<CASSSE2, uint8_t>, kernels_simd<CASSSE2, uint16_t>, kernels_simd<CASSSE2, float> },
+    { kernels_simd<CASAVX2, uint8_t>, kernels_simd<CASAVX2, uint16_t>, kernels_simd<CASAVX2, float> },
+    { kernels_simd<CASAVX512, uint8_t>, kernels_simd<CASAVX512, uint16_t>, kernels_simd<CASAVX512, float> },
+#endif
+};
+
+static CASResize resizeMap(const int src, const int dst) {
+    // Center-aligned mapping from destination samples to the top/left tap of their 2x2 source footprint.
+    CASResize map;
+    const int padded = (dst + 15) & ~15;
+    map.index.resize(padded);
+    map.frac.resize(padded);
+
+    for (int i = 0; i < padded; i++) {
+        const double pos = (std::min(i, dst - 1) + 0.5) * src / dst - 0.5;
+        int index = static_cast<int>(std::floor(pos));
+        float frac = static_cast<float>(pos - index);
+
+        if (index < 0) {
+            index = 0;
+            frac = 0.0f;
+        } else if (index >= src - 1) {
+            index = src - 2;
+            frac = 1.0f;
+        }
+
+        map.index[i] = index;
+        map.frac[i] = frac;
+    }
+
+    return map;
+}
+
+// The inverse transfer table covers linear values from 2^linearMinExponent to 2^linearMaxExponent in linearSteps steps per octave. Values
+// above 1 come from codes above white in limited range, which reach about 2.5 with PQ.
+static constexpr int linearMinExponent = -48;
+static constexpr int linearMaxExponent = 8;
+static constexpr int linearSteps = 128;
+
+void casConfigure(CASKernel * d, const CASConfig & config) {
+    if (config.num_planes != 1 && config.num_planes != 3)
+        throw "num_planes must be 1 or 3";
+
+    if (config.subsampling_w < 0 || config.subsampling_w > 4 || config.subsampling_h < 0 || config.subsampling_h > 4)
+        throw "subsampling_w and subsampling_h must be between 0 and 4 (inclusive)";
+
+    if (config.width % (1 << config.subsampling_w) || config.height % (1 << config.subsampling_h))
+        throw "width and height must be mod subsampling";
+
+    if ((!config.float_samples && (config.bits_per_sample < 8 || config.bits_per_sample > 16)) || (config.float_samples && config.bits_per_sample != 32))
+        throw "only 8-16 bit integer and 32 bit float samples supported";
+
+    const bool upscale = config.dst_width || config.dst_height;
+    const int dstWidth = upscale ? config.dst_width : config.width;
+    const int dstHeight = upscale ? config.dst_height : config.height;
+
+    for (int plane = 0; plane < config.num_planes; plane++) {
+        if (config.width >> (plane ? config.subsampling_w : 0) < 3)
+            throw "plane's width must be greater than or equal to 3";
+
+        if (config.height >> (plane ? config.subsampling_h : 0) < 3)
+            throw "plane's height must be greater than or equal to 3";
+    }
+
+    if (config.planes < 0 || config.planes >= 1 << config.num_planes)
+        throw "plane index out of range";
+
+    if (config.sharpness < 0.0f || config.sharpness > 1.0f)
+        throw "sharpness must be between 0.0 and 1.0 (inclusive)";
+
+    if (config.amp_scale != 1 && config.amp_scale != 2)
+        throw "amp_scale must be 1 or 2";
+
+    if (config.opt < 0 || config.opt > 4)
+        throw "opt must be 0, 1, 2, 3, or 4";
+
+    if (upscale) {
+        if (dstWidth < config.width || dstHeight < config.height)
+            throw "width and height must be greater than or equal to the clip's dimensions";
+
+        if (dstWidth % (1 << config.subsampling_w) || dstHeight % (1 << config.subsampling_h))
+            throw "width and height must be mod subsampling";
+
+        if (config.shared_amp)
+            throw "shared_amp is not supported when upscaling";
+
+        if (config.amp_scale == 2)
+            throw "amp_scale is not supported when upscaling";
+    }
+
+    if (config.shared_amp && config.amp_scale == 2)
+        throw "amp_scale is not supported with shared_amp";
+
+    if (config.fields) {
+        for (int plane = 0; plane < config.num_planes; plane++) {
+            if ((config.height >> (plane ? config.subsampling_h : 0)) / 2 < 3)
+                throw "plane's field height must be greater than or equal to 3";
+        }
+
+        if (config.height % (2 << config.subsampling_h))
+            throw "height must be mod 2 * subsampling with fields";
+
+        if (upscale && dstHeight % (2 << config.subsampling_h))
+            throw "the clip's height and height must be mod 2 * subsampling with fields when upscaling";
+    }
+
+    if (config.linear) {
+        if (config.linear < 0 || config.linear > 3)
+            throw "linear must be 0, 1, 2 or 3";
+
+        if (config.float_samples)
+            throw "linear is only supported for integer samples";
+
+        if (config.shared_amp || config.amp_scale == 2 || upscale)
+            throw "linear is not supported with shared_amp, amp_scale or upscaling";
+    }
+
+    d->numPlanes = config.num_planes;
+    d->subSamplingW = config.subsampling_w;
+    d->subSamplingH = config.subsampling_h;
+    d->bytesPerSample = config.float_samples ? 4 : (config.bits_per_sample + 7) / 8;
+    d->rgb = !!config.rgb;
+    d->sharpness = config.sharpness;
+    for (int plane = 0; plane < 3; plane++)
+        d->process[plane] = !!(config.planes & (1 << plane));
+    d->sharedAmp = !!config.shared_amp;
+    d->ampScale = config.amp_scale;
+    d->fields = !!config.fields;
+    d->padded = !!config.padded;
+
+    for (int plane = 0; plane < config.num_planes; plane++) {
+        d->width[plane] = config.width >> (plane ? config.subsampling_w : 0);
+        d->height[plane] = config.height >> (plane ? config.subsampling_h : 0);
+        d->linear[plane] = config.linear && (plane == 0 || config.rgb);
+    }
+    d->rowSize = (((static_cast<size_t>(config.width) + 63) & ~static_cast<size_t>(63)) + 64) * (config.linear ? sizeof(float) : d->bytesPerSample);
+
+    // The kernels take at most a ring or window of four rows and three bordered rows from the scratch arena per call, or the float rows of
+    // shared_amp, amp_scale and upscaling.
+    casReserveScratch(std::max(d->rowSize * 8 + 512, (static_cast<size_t>(config.width) + 64) * (upscale ? 12 : 4) * sizeof(float)), !!config.huge_pages);
+
+    for (int plane = 0; plane < 3; plane++) {
+        d->columns[plane] = {};
+        d->rows[plane] = {};
+    }
+
+    if (upscale) {
+        for (int plane = 0; plane < config.num_planes; plane++) {
+            const int ssw = plane ? config.subsampling_w : 0;
+            const int ssh = plane ? config.subsampling_h : 0;
+            d->columns[plane] = resizeMap(config.width >> ssw, dstWidth >> ssw);
+            d->rows[plane] = resizeMap((config.height >> ssh) >> d->fields, (dstHeight >> ssh) >> d->fields);
+        }
+    }
+
+    int isa = 0;
+#ifdef CAS_X86
+    const int opt = config.opt;
+    const int iset = instrset_detect();
+    if ((opt == 0 && iset >= 10) || opt == 4)
+        isa = 3;
+    else if ((opt == 0 && iset >= 8) || opt == 3)
+        isa = 2;
+    else if ((opt == 0 && iset >= 2) || opt == 2)
+        isa = 1;
+#endif
+
+    d->isa = isa;
+    const CASKernels & kernels = kernelTable[isa][d->bytesPerSample == 1 ? 0 : (d->bytesPerSample == 2 ? 1 : 2)];
+    d->filter = upscale ? kernels.upscale : kernels.filter;
+    d->filterRow = kernels.filterRow;
+    d->analyzeRow = kernels.analyzeRow;
+
+    // The float row kernels of the same instruction set sharpen and measure linear planes.
+    const auto filterRowFloat = kernelTable[isa][2].filterRow;
+    const auto analyzeRowFloat = kernelTable[isa][2].analyzeRow;
+
+    auto lerp = [](const float a, const float b, const float t) noexcept { return a + (b - a) * t; };
+    d->sharpness = -1.0f / lerp(16.0f, 5.0f, d->sharpness);
+
+    if (!config.float_samples) {
+        d->limit = (1 << (config.bits_per_sample + 1)) - 1;
+        d->peak = (1 << config.bits_per_sample) - 1;
+    } else {
+        d->limit = 2.0f;
+    }
+    d->clipLow = 0.0f;
+    d->clipHigh = 1.0f;
+
+    d->linearKernel = nullptr;
+    if (config.linear) {
+        // Linear planes are sharpened by the float kernel on values in [0, 1].
+        d->linearKernel = std::make_unique<CASKernel>();
+        d->linearKernel->sharpness = d->sharpness;
+        d->linearKernel->limit = 2.0f;
+        d->linearKernel->filterRow = filterRowFloat;
+        d->linearKernel->analyzeRow = analyzeRowFloat;
+
+        const int shift = config.bits_per_sample - 8;
+        d->black = config.rgb ? 0.0f : static_cast<float>(16 << shift);
+        const double range = config.rgb ? d->peak : (235 << shift) - (16 << shift);
+
+        auto eotf = [&](const double v) noexcept {
+            const double a = std::abs(v);
+            double l;
+            if (config.linear == 1) {
+                l = std::pow(a, 2.4);
+            } else if (config.linear == 2) {
+                l = a <= 0.04045 ? a / 12.92 : std::pow((a + 0.055) / 1.055, 2.4);
+            } else {
+                const double p = std::pow(a, 4096.0 / (2523.0 * 128.0));
+                l = std::pow(std::max(p - 3424.0 / 4096.0, 0.0) / (2413.0 / 4096.0 * 32.0 - 2392.0 / 4096.0 * 32.0 * p), 16384.0 / 2610.0);
+            }
+            return v < 0.0 ? -l : l;
+        };
+
+        auto inverseEotf = [&](const double l) noexcept {
+            if (config.linear == 1)
+                return std::pow(l, 1.0 / 2.4);
+            if (config.linear == 2)
+                return l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+            const double p = std::pow(l, 2610.0 / 16384.0);
+            return std::pow((3424.0 / 4096.0 + 2413.0 / 4096.0 * 32.0 * p) / (1.0 + 2392.0 / 4096.0 * 32.0 * p), 2523.0 / 4096.0 * 128.0);
+        };
+
+        d->toLinear.resize(d->peak + 1);
+        for (int code = 0; code <= d->peak; code++)
+            d->toLinear[code] = static_cast<float>(eotf((code - d->black) / range));
+
+        // Linear values only clip where they map back past the first or last code value.
+        d->linearKernel->clipLow = d->toLinear[0];
+        d->linearKernel->clipHigh = d->toLinear[d->peak];
+
+        d->fromLinear.resize((linearMaxExponent - linearMinExponent) * linearSteps + 1);
+        for (size_t i = 0; i < d->fromLinear.size(); i++) {
+            const double l = std::ldexp(1.0 + static_cast<double>(i % linearSteps) / linearSteps, static_cast<int>(i / linearSteps) + linearMinExponent);
+            d->fromLinear[i] = static_cast<float>(inverseEotf(l) * range);
+        }
+    }
+}
+
+// Samples of linear planes are mapped to linear light through a table with an entry per code value. The inverse is a table indexed by
+// the exponent and top mantissa bits of the linear value, interpolated linearly within each step, which stays well below half a code
+// value even at 16 bits.
+template<typename pixel_t>
+static void toLinear(const CASKernel * d, const pixel_t * srcp, float * dstp, const int width) noexcept {
+    const float * table = d->toLinear.data();
+    for (int x = 0; x < width; x++)
+        dstp[x] = table[std::min<int>(srcp[x], d->peak)];
+
+    // The padding past the row repeats its last sample, as the kernels may read a vector past the right edge.
+    for (int x = width; x < width + 64; x++)
+        dstp[x] = dstp[width - 1];
+}
+
+template<typename pixel_t>
+static void fromLinear(const CASKernel * d, const float * srcp, pixel_t * dstp, const int width) noexcept {
+    const float * table = d->fromLinear.data();
+    const uint32_t first = (127 + linearMinExponent) * linearSteps;
+    const uint32_t last = static_cast<uint32_t>(d->fromLinear.size()) - 1;
+    const float tiny = std::ldexp(table[0], -linearMinExponent);
+    const float peak = static_cast<float>(d->peak);
+
+    for (int x = 0; x < width; x++) {
+        // Values below black, as sharpening overshoots, mirror the transfer around it. A window of zeros sharpens to 0 / 0 in the
+        // amplitude, which is black too.
+        const float value = std::isnan(srcp[x]) ? 0.0f : srcp[x];
+        const float magnitude = std::abs(value);
+        uint32_t bits;
+        std::memcpy(&bits, &magnitude, sizeof(bits));
+
+        float offset;
+        const uint32_t index = (bits >> 16) - first;
+        if (bits >> 16 < first)
+            offset = magnitude * tiny;
+        else if (index >= last)
+            offset = table[last];
+        else
+            offset = table[index] + (table[index + 1] - table[index]) * ((bits & 0xFFFF) * (1.0f / 65536.0f));
+
+        const float code = d->black + (value < 0.0f ? -offset : offset);
+        dstp[x] = static_cast<pixel_t>(std::min(std::max(code, 0.0f), peak) + 0.5f);
+    }
+}
+
+// Rows of a plane that cannot be handed to the kernels directly, because it is processed in place, lacks the padding or arrives in
+// slices, pass through a window of the last three source rows and an output row, all aligned and padded.
+struct CASWindow final {
+    uint8_t * rows;
+    uint8_t * out;
+    int height;
+    int received;
+};
+
+static CASWindow windowAt(const CASKernel * d, uint8_t * scratch, const int height) noexcept {
+    return { scratch, scratch + d->rowSize * 3, height, 0 };
+}
+
+// Takes the next source row, and stores every output row whose row below is now known. A source row is copied before the output of
+// the row above it is stored, so that in place processing never reads its own output.
+static void windowPush(const CASKernel * d, const int plane, CASWindow & w, const uint8_t * srcp, uint8_t * dstp, const ptrdiff_t dstStride) noexcept {
+    const int width = d->width[plane];
+    const int height = w.height;
+    const size_t rowBytes = static_cast<size_t>(width) * d->bytesPerSample;
+    const int y = w.received++;
+
+    auto row = [&](const int y) noexcept { return w.rows + d->rowSize * (y % 3); };
+
+    auto emit = [&](const int y, const uint8_t * above, const uint8_t * below) noexcept {
+        if (d->linear[plane]) {
+            d->linearKernel->filterRow(above, row(y), below, w.out, width, 0, d->linearKernel.get());
+            if (d->bytesPerSample == 1)
+                fromLinear(d, reinterpret_cast<const float *>(w.out), dstp + y * dstStride, width);
+            else
+                fromLinear(d, reinterpret_cast<const float *>(w.out), reinterpret_cast<uint16_t *>(dstp + y * dstStride), width);
+        } else if (d->padded) {
+            d->filterRow(above, row(y), below, dstp + y * dstStride, width, plane, d);
+        } else {
+            d->filterRow(above, row(y), below, w.out, width, plane, d);
+            std::memcpy(dstp + y * dstStride, w.out, rowBytes);
+        }
+    };
+
+    if (!d->linear[plane])
+        std::memcpy(row(y), srcp, rowBytes);
+    else if (d->bytesPerSample == 1)
+        toLinear(d, srcp, reinterpret_cast<float *>(row(y)), width);
+    else
+        toLinear(d, reinterpret_cast<const uint16_t *>(srcp), reinterpret_cast<float *>(row(y)), width);
+
+    if (y >= 1)
+        emit(y - 1, row(y == 1 ? 1 : y - 2), row(y));
+    if (y == height - 1)
+        emit(y, row(y - 1), row(y - 1));
+}
+
+static void filterRows(const CASKernel * d, const int plane, const uint8_t * srcp, const ptrdiff_t srcStride, uint8_t * dstp, const ptrdiff_t dstStride,
+                       uint8_t * scratch) noexcept {
+    const int fields = d->fields ? 2 : 1;
+
+    for (int field = 0; field < fields; field++) {
+        CASWindow w = windowAt(d, scratch, (d->height[plane] + fields - 1 - field) / fields);
+        for (int y = 0; y < w.height; y++)
+            windowPush(d, plane, w, srcp + (y * fields + field) * srcStride, dstp + field * dstStride, dstStride * fields);
+    }
+}
+
+void casFilter(const CASPlanes & planes, const CASKernel * d) noexcept {
+    // Statistics come from the plain kernel while it sharpens the guide plane, and from a pass of their own with every other kernel.
+    const int guide = d->rgb ? 1 : 0;
+    if (planes.stats && (d->linearKernel || d->sharedAmp || d->ampScale == 2 || !d->process[guide] || planes.dstWidth[0] != planes.width[0] ||
+                         planes.dstHeight[0] != planes.height[0])) {
+        casAnalyze(planes, d, planes.stats);
+
+        CASPlanes rest = planes;
+        rest.stats = nullptr;
+        casFilter(rest, d);
+        return;
+    }
+
+    if (d->linearKernel) {
+        // Linear planes are converted row by row on the way in and out of the float kernel, so every plane goes through the row window.
+        CASScratch scratch{ d->rowSize * 4 };
+        uint8_t * aligned = scratch.get<uint8_t>();
+
+        for (int plane = 0; plane < d->numPlanes; plane++) {
+            if (d->process[plane])
+                filterRows(d, plane, static_cast<const uint8_t *>(planes.srcp[plane]), planes.srcStride[plane] * d->bytesPerSample,
+                           static_cast<uint8_t *>(planes.dstp[plane]), planes.dstStride[plane] * d->bytesPerSample, aligned);
+        }
+        return;
+    }
+
+    if (!d->fields) {
+        d->filter(planes, d);
+        return;
+    }
+
+    // Each field is a plane of its own, starting one row apart and stepping over the rows of the other field.
+    for (int field = 0; field < 2; field++) {
+        CASPlanes f = planes;
+        for (int plane = 0; plane < d->numPlanes; plane++) {
+            f.srcp[plane] = static_cast<const uint8_t *>(planes.srcp[plane]) + field * planes.srcStride[plane] * d->bytesPerSample;
+            f.srcStride[plane] = planes.srcStride[plane] * 2;
+            f.height[plane] = (planes.height[plane] + 1 - field) / 2;
+            f.dstHeight[plane] = (planes.dstHeight[plane] + 1 - field) / 2;
+
+            if (planes.dstp[plane]) {
+                f.dstp[plane] = static_cast<uint8_t *>(planes.dstp[plane]) + field * planes.dstStride[plane] * d->bytesPerSample;
+                f.dstStride[plane] = planes.dstStride[plane] * 2;
+            }
+        }
+
+        d->filter(f, d);
+    }
+}
+
+void casAnalyze(const CASPlanes & planes, const CASKernel * d, CASStats * stats) noexcept {
+    const int guide = d->rgb ? 1 : 0;
+    const int fields = d->fields ? 2 : 1;
+    const int width = planes.width[guide];
+    const ptrdiff_t stride = planes.srcStride[guide] * d->bytesPerSample;
+
+    if (d->linear[guide]) {
+        // A linear guide plane is measured on the linear values the float kernel sharpens, converted once each into a ring of three rows.
+        CASScratch scratch{ d->rowSize * 3 };
+        auto row = [&](const int y) noexcept { return scratch.get<uint8_t>() + d->rowSize * (y % 3); };
+
+        for (int field = 0; field < fields; field++) {
+            const int height = (planes.height[guide] + fields - 1 - field) / fields;
+            const uint8_t * srcp = static_cast<const uint8_t *>(planes.srcp[guide]) + field * stride;
+
+            auto convert = [&](const int y) noexcept {
+                if (d->bytesPerSample == 1)
+                    toLinear(d, srcp + y * stride * fields, reinterpret_cast<float *>(row(y)), width);
+                else
+                    toLinear(d, reinterpret_cast<const uint16_t *>(srcp + y * stride * fields), reinterpret_cast<float *>(row(y)), width);
+            };
+
+            convert(0);
+            for (int y = 0; y < height; y++) {
+                if (y + 1 < height)
+                    convert(y + 1);
+                d->linearKernel->analyzeRow(row(y == 0 ? 1 : y - 1), row(y), row(y == height - 1 ? y - 1 : y + 1), nullptr, width, 0, d->linearKernel.get(),
+                                            stats);
+            }
+        }
+        return;
+    }
+
+    for (int field = 0; field < fields; field++) {
+        const int height = (planes.height[guide] + fields - 1 - field) / fields;
+        const uint8_t * srcp = static_cast<const uint8_t *>(planes.srcp[guide]) + field * stride;
+
+        for (int y = 0; y < height; y++) {
+            const uint8_t * above = srcp + (y == 0 ? stride : -stride) * fields;
+            const uint8_t * below = srcp + (y == height - 1 ? -stride : stride) * fields;
+
+            d->analyzeRow(above, srcp, below, nullptr, width, guide, d, stats);
+
+            srcp += stride * fields;
+        }
+    }
+}
+
+//////////////////////////////////////////
+// C API
+
+// Worker threads of cas_process_batch, started by the first batch and kept for later ones with their scratch buffers and arenas. Each batch
+// wakes as many of them as it uses, and runs one at a time per context.
+struct CASPool final {
+    ~CASPool();
+
+    const char * run(const CASContext * context, const CASImage * images, const int count, const int threads);
+
+private:
+    void work(const CASContext * context, uint8_t * scratch) noexcept;
+
+    std::mutex batchMutex;
+    std::unique_ptr<uint8_t[]> scratch;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    uint64_t generation = 0;
+    int helpers = 0;
+    int finished = 0;
+    bool stop = false;
+
+    const CASImage * images = nullptr;
+    int count = 0;
+    std::atomic<int> next{ 0 };
+    std::atomic<const char *> error{ nullptr };
+};
+
+struct CASContext final : CASKernel {
+    CASConfig config;
+    mutable CASPool pool;
+};
+
+CASPool::~CASPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for (auto & worker : workers)
+        worker.join();
+}
+
+const char * CASPool::run(const CASContext * context, const CASImage * images, const int count, const int threads) {
+    std::lock_guard<std::mutex> batch(batchMutex);
+
+    if (!scratch)
+        scratch = std::make_unique<uint8_t[]>(cas_scratch_size(context));
+
+    while (static_cast<int>(workers.size()) < threads - 1) {
+        const int index = static_cast<int>(workers.size());
+        workers.emplace_back([this, context, index]() noexcept {
+            std::unique_ptr<uint8_t[]> scratch = std::make_unique<uint8_t[]>(cas_scratch_size(context));
+            uint64_t seen = 0;
+
+            for (;;) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wake.wait(lock, [&] { return stop || generation != seen; });
+                    if (stop)
+                        return;
+                    seen = generation;
+                    if (index >= helpers)
+                        continue;
+                }
+
+                work(context, scratch.get());
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (++finished == helpers)
+                    done.notify_one();
+            }
+        });
+    }
+
+    this->images = images;
+    this->count = count;
+    next = 0;
+    error = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        helpers = threads - 1;
+        finished = 0;
+        generation++;
+    }
+    wake.notify_all();
+
+    work(context, scratch.get());
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return finished == helpers; });
+    return error;
+}
+
+// Images are handed out one at a time, so that a few slow ones do not hold up a thread's whole share of the batch.
+void CASPool::work(const CASContext * context, uint8_t * scratch) noexcept {
+    for (int i; (i = next++) < count && !error.load(std::memory_order_relaxed); ) {
+        const CASImage & image = images[i];
+        const char * message = cas_process(context, image.src, image.src_stride, image.dst, image.dst_stride, scratch);
+        if (message) {
+            const char * expected = nullptr;
+            error.compare_exchange_strong(expected, message);
+        }
+    }
+}
+
+void cas_default_config(CASConfig * config, const int width, const int height, const int num_planes, const int subsampling_w, const int subsampling_h,
+                        const int bits_per_sample, const int float_samples, const int rgb) {
+    *config = {};
+    config->width = width;
+    config->height = height;
+    config->num_planes = num_planes;
+    config->subsampling_w = subsampling_w;
+    config->subsampling_h = subsampling_h;
+    config->bits_per_sample = bits_per_sample;
+    config->float_samples = float_samples;
+    config->rgb = rgb;
+    config->planes = rgb ? (1 << num_planes) - 1 : 1;
+    config->sharpness = 0.5f;
+    config->amp_scale = 1;
+}
+
+CASContext * cas_create(const CASConfig * config, const char ** error) {
+    std::unique_ptr<CASContext> d = std::make_unique<CASContext>();
+
+    try {
+        casConfigure(d.get(), *config);
+    } catch (const char * message) {
+        if (error)
+            *error = message;
+        return nullptr;
+    }
+
+    d->config = *config;
+
+    if (error)
+        *error = nullptr;
+    return d.release();
+}
+
+void cas_free(CASContext * context) {
+    delete context;
+}
+
+size_t cas_scratch_size(const CASContext * context) {
+    return context->rowSize * 4 + 64;
+}
+
+const char * cas_process(const CASContext * context, const void * const src[], const ptrdiff_t src_stride[], void * const dst[], const ptrdiff_t dst_stride[],
+                         void * scratch) {
+    const CASContext * d = context;
+    const bool upscale = d->config.dst_width || d->config.dst_height;
+
+    bool inPlace = false;
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (src_stride[plane] % d->bytesPerSample || dst_stride[plane] % d->bytesPerSample)
+            return "strides must be a multiple of the sample size";
+
+        if (d->config.padded && ((reinterpret_cast<uintptr_t>(src[plane]) | reinterpret_cast<uintptr_t>(dst[plane]) | src_stride[plane] | dst_stride[plane]) & 63))
+            return "planes and strides must be 64 byte aligned when padded is set";
+
+        inPlace |= (d->process[plane] || upscale) && src[plane] == dst[plane];
+    }
+
+    if (!d->config.padded || inPlace) {
+        if (d->sharedAmp || d->ampScale == 2 || upscale)
+            return "shared_amp, amp_scale and upscaling need padded planes and a separate destination";
+
+        if (!scratch)
+            return "a scratch buffer is needed to process in place or without padded";
+    }
+
+    if (d->config.padded && !inPlace) {
+        CASPlanes planes = {};
+        for (int plane = 0; plane < d->numPlanes; plane++) {
+            const int ssw = plane ? d->subSamplingW : 0;
+            const int ssh = plane ? d->subSamplingH : 0;
+            planes.srcp[plane] = src[plane];
+            planes.dstp[plane] = dst[plane];
+            planes.srcStride[plane] = src_stride[plane] / d->bytesPerSample;
+            planes.dstStride[plane] = dst_stride[plane] / d->bytesPerSample;
+            planes.width[plane] = d->width[plane];
+            planes.height[plane] = d->height[plane];
+            planes.dstWidth[plane] = upscale ? d->config.dst_width >> ssw : d->width[plane];
+            planes.dstHeight[plane] = upscale ? d->config.dst_height >> ssh : d->height[plane];
+        }
+
+        casFilter(planes, d);
+    } else {
+        uint8_t * aligned = reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(scratch) + 63) & ~static_cast<uintptr_t>(63));
+
+        for (int plane = 0; plane < d->numPlanes; plane++) {
+            if (d->process[plane])
+                filterRows(d, plane, static_cast<const uint8_t *>(src[plane]), src_stride[plane], static_cast<uint8_t *>(dst[plane]), dst_stride[plane], aligned);
+        }
+    }
+
+    // Unprocessed planes are copied, unless the output already is the input.
+    if (!upscale) {
+        for (int plane = 0; plane < d->numPlanes; plane++) {
+            if (!d->process[plane] && src[plane] != dst[plane]) {
+                const uint8_t * srcp = static_cast<const uint8_t *>(src[plane]);
+                uint8_t * dstp = static_cast<uint8_t *>(dst[plane]);
+                for (int y = 0; y < d->height[plane]; y++)
+                    std::memcpy(dstp + y * dst_stride[plane], srcp + y * src_stride[plane], static_cast<size_t>(d->width[plane]) * d->bytesPerSample);
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+const char * cas_process_batch(const CASContext * context, const CASImage * images, const int count, int threads) {
+    if (threads <= 0)
+        threads = static_cast<int>(std::thread::hardware_concurrency());
+    threads = std::max(std::min(threads, count), 1);
+
+    return context->pool.run(context, images, count, threads);
+}
+
+// With fields, each plane has a window per field, and the rows pushed alternate between them.
+struct CASSlice final {
+    const CASContext * context;
+    std::unique_ptr<uint8_t[]> scratch;
+    CASWindow windows[3][2];
+    int received[3];
+    void * dst[3];
+    ptrdiff_t dstStride[3];
+    bool begun;
+};
+
+CASSlice * cas_slice_create(const CASContext * context, const char ** error) {
+    const CASContext * d = context;
+
+    if (d->sharedAmp || d->ampScale == 2 || d->config.dst_width || d->config.dst_height) {
+        if (error)
+            *error = "shared_amp, amp_scale and upscaling need the whole frame and cannot be used with slices";
+        return nullptr;
+    }
+
+    std::unique_ptr<CASSlice> slice = std::make_unique<CASSlice>();
+    slice->context = d;
+    slice->scratch = std::make_unique<uint8_t[]>(d->rowSize * 4 * 2 * d->numPlanes + 64);
+    slice->begun = false;
+
+    const int fields = d->fields ? 2 : 1;
+    uint8_t * aligned = reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(slice->scratch.get()) + 63) & ~static_cast<uintptr_t>(63));
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        for (int field = 0; field < 2; field++)
+            slice->windows[plane][field] = windowAt(d, aligned + d->rowSize * 4 * (plane * 2 + field), (d->height[plane] + fields - 1 - field) / fields);
+    }
+
+    if (error)
+        *error = nullptr;
+    return slice.release();
+}
+
+void cas_slice_free(CASSlice * slice) {
+    delete slice;
+}
+
+const char * cas_slice_begin(CASSlice * slice, void * const dst[], const ptrdiff_t dst_stride[]) {
+    const CASContext * d = slice->context;
+
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        if (dst_stride[plane] % d->bytesPerSample)
+            return "strides must be a multiple of the sample size";
+
+        if (d->config.padded && ((reinterpret_cast<uintptr_t>(dst[plane]) | dst_stride[plane]) & 63))
+            return "planes and strides must be 64 byte aligned when padded is set";
+    }
+
+    for (int plane = 0; plane < d->numPlanes; plane++) {
+        slice->windows[plane][0].received = slice->windows[plane][1].received = 0;
+        slice->received[plane] = 0;
+        slice->dst[plane] = dst[plane];
+        slice->dstStride[plane] = dst_stride[plane];
+    }
+    slice->begun = true;
+    return nullptr;
+}
+
+const char * cas_slice_push(CASSlice * slice, const int plane, const void * src, const ptrdiff_t src_stride, const int rows, int * finished) {
+    const CASContext * d = slice->context;
+
+    if (!slice->begun)
+        return "cas_slice_begin must be called before pushing rows";
+
+    if (plane < 0 || plane >= d->numPlanes)
+        return "plane index out of range";
+
+    int & received = slice->received[plane];
+    if (rows < 0 || rows > d->height[plane] - received)
+        return "more rows pushed than the plane has";
+
+    const int fields = d->fields ? 2 : 1;
+    const uint8_t * srcp = static_cast<const uint8_t *>(src);
+    uint8_t * dstp = static_cast<uint8_t *>(slice->dst[plane]);
+    const ptrdiff_t dstStride = slice->dstStride[plane];
+
+    for (int y = 0; y < rows; y++, received++) {
+        if (d->process[plane]) {
+            const int field = received % fields;
+            windowPush(d, plane, slice->windows[plane][field], srcp + y * src_stride, dstp + field * dstStride, dstStride * fields);
+        } else if (srcp + y * src_stride != dstp + received * dstStride) {
+            std::memcpy(dstp + received * dstStride, srcp + y * src_stride, static_cast<size_t>(d->width[plane]) * d->bytesPerSample);
+        }
+    }
+
+    if (finished) {
+        // A row is final once the row below it in its field has been pushed, so with fields the final rows alternate between the two.
+        auto done = [&](const CASWindow & w) noexcept { return w.received == w.height ? w.received : std::max(w.received - 1, 0); };
+
+        if (!d->process[plane])
+            *finished = received;
+        else if (fields == 1)
+            *finished = done(slice->windows[plane][0]);
+        else
+            *finished = std::min({ done(slice->windows[plane][0]) * 2, done(slice->windows[plane][1]) * 2 + 1, d->height[plane] });
+    }
+    return nullptr;
+}
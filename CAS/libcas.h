@@ -0,0 +1,110 @@
+#ifndef LIBCAS_H
+#define LIBCAS_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+    Contrast Adaptive Sharpening on caller-owned planes.
+
+    Planes are passed as pointers and strides in bytes, and are never copied unless the layout requires it. The output may be the input
+    itself when a scratch buffer of cas_scratch_size bytes is given. Errors are returned as static strings, and null means success.
+*/
+
+typedef struct CASContext CASContext;
+
+typedef struct CASConfig {
+    /* Dimensions of the first plane, mod subsampling, or in height mod 2 * subsampling with fields. Every plane must be at least 3x3. */
+    int width;
+    int height;
+    /* 1 or 3 planes, where the second and third are subsampled by 1 << subsampling_w and 1 << subsampling_h. */
+    int num_planes;
+    int subsampling_w;
+    int subsampling_h;
+    /* 8-16 for integer samples, or 32 with float_samples set. */
+    int bits_per_sample;
+    int float_samples;
+    /* Set for RGB, where all planes are sharpened by default and shared_amp takes its amplitude from G. Otherwise the first plane is luma. */
+    int rgb;
+    /* Bit mask of planes to sharpen; the others are copied. */
+    int planes;
+    /* 0.0-1.0. */
+    float sharpness;
+    /* Same as the shared_amp and amp_scale arguments of the VapourSynth filter. */
+    int shared_amp;
+    int amp_scale;
+    /* Set for interlaced frames to sharpen each field on its own, with the rows above and below taken from the same field. */
+    int fields;
+    /* 0 to sharpen the samples as they are, or the transfer of integer samples to sharpen them in linear light: 1 = BT.709/BT.1886
+       (gamma 2.4), 2 = sRGB, 3 = SMPTE ST 2084 (PQ). This applies to every plane of RGB and to the luma of YUV and Gray, which is taken
+       as limited range. */
+    int linear;
+    /* Output dimensions when upscaling, or 0 for the input dimensions. */
+    int dst_width;
+    int dst_height;
+    /* Set when every row is 64 byte aligned and may be read and written up to the next multiple of 64 bytes past its end, as with
+       VapourSynth and FFmpeg frames. The kernels then work on the planes directly, otherwise each row goes through the scratch buffer.
+       shared_amp, amp_scale and upscaling require it. */
+    int padded;
+    /* 0 = auto detect, 1 = c, 2 = sse2, 3 = avx2, 4 = avx512. */
+    int opt;
+    /* Set to back the scratch memory that the kernels share across contexts with transparent huge pages on Linux. It applies to every
+       context once any context is created with it. */
+    int huge_pages;
+} CASConfig;
+
+/* Fills in the defaults for the given format: sharpness 0.5, the planes sharpened by the VapourSynth filter, and no other options. */
+void cas_default_config(CASConfig * config, int width, int height, int num_planes, int subsampling_w, int subsampling_h, int bits_per_sample,
+                        int float_samples, int rgb);
+
+CASContext * cas_create(const CASConfig * config, const char ** error);
+
+void cas_free(CASContext * context);
+
+/* Size of the scratch buffer needed to process in place or without padded set. It holds four rows of the widest plane. */
+size_t cas_scratch_size(const CASContext * context);
+
+/* A context may be used by any number of threads at once, each with its own scratch buffer. scratch may be null when it is not needed. */
+const char * cas_process(const CASContext * context, const void * const src[], const ptrdiff_t src_stride[], void * const dst[], const ptrdiff_t dst_stride[],
+                         void * scratch);
+
+typedef struct CASImage {
+    const void * src[3];
+    ptrdiff_t src_stride[3];
+    void * dst[3];
+    ptrdiff_t dst_stride[3];
+} CASImage;
+
+/* Sharpens count images of the context's format in one call, such as thumbnails, spread over threads threads (0 = all cores). The threads
+   are started by the first call and kept by the context, with their scratch buffers, until it is freed. Calls on the same context run one
+   batch at a time. Returns the first error, after which the remaining images may be left unprocessed. */
+const char * cas_process_batch(const CASContext * context, const CASImage * images, int count, int threads);
+
+/*
+    Sharpens frames that arrive as horizontal slices of rows, such as from slice threaded decoders. Each plane keeps a window of its last
+    three source rows, and an output row is stored in the destination as soon as the row below it has been pushed, so the latency is one
+    row. Pushed rows are copied, so the slice buffer may be reused or be the destination itself once cas_slice_push returns. A slice
+    processor is used by one thread at a time. shared_amp, amp_scale and upscaling need the whole frame and are not supported.
+*/
+
+typedef struct CASSlice CASSlice;
+
+CASSlice * cas_slice_create(const CASContext * context, const char ** error);
+
+void cas_slice_free(CASSlice * slice);
+
+/* Starts a new frame, whose output is stored in dst. */
+const char * cas_slice_begin(CASSlice * slice, void * const dst[], const ptrdiff_t dst_stride[]);
+
+/* Pushes the next rows of a plane. Planes may be pushed in any order. finished, when not null, receives the number of rows of the plane
+   that are now final in the destination, counted from the top. */
+const char * cas_slice_push(CASSlice * slice, int plane, const void * src, ptrdiff_t src_stride, int rows, int * finished);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif